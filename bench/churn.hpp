@@ -0,0 +1,51 @@
+#ifndef BENCH_CHURN
+#define BENCH_CHURN
+
+#include <boost/lexical_cast.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include "common.hpp"
+
+template <template <typename T> class Container, typename T>
+int bench_churn(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <count> <rounds>\n";
+    return EXIT_FAILURE;
+  }
+
+  auto count = boost::lexical_cast<std::size_t>(argv[1]);
+  auto rounds = boost::lexical_cast<std::size_t>(argv[2]);
+  if (count == 0 || rounds == 0) {
+    std::cerr << "count and rounds must not be 0\n";
+    return EXIT_FAILURE;
+  }
+
+  Container<T> container;
+  bench("Push front", [&] {
+    for (std::size_t i = 0; i != count; ++i)
+      container.push_front(static_cast<T>(i));
+  });
+  bench("Churn front", [&] {
+    for (std::size_t i = 0; i != rounds; ++i) {
+      container.pop_front();
+      container.push_front(static_cast<T>(count + i));
+    }
+  });
+  verify(container.front(), static_cast<T>(count + rounds - 1));
+  auto rotated = container[(count - rounds % count) % count];
+  bench("Rotate", [&] {
+    for (std::size_t i = 0; i != rounds; ++i) {
+      container.push_front(container.back());
+      container.pop_back();
+    }
+  });
+  verify(container.size(), count);
+  verify(container.front(), rotated);
+  bench("Pop front", [&] {
+    for (std::size_t i = 0; i != count; ++i) container.pop_front();
+  });
+  verify(container.size(), std::size_t{0});
+  return EXIT_SUCCESS;
+}
+
+#endif  // #ifndef BENCH_CHURN
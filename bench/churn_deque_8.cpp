@@ -0,0 +1,9 @@
+#include <deque>
+#include "churn.hpp"
+
+template <typename T>
+using Container = std::deque<T>;
+
+int main(int argc, char** argv) {
+  return bench_churn<Container, std::uint8_t>(argc, argv);
+}
@@ -0,0 +1,9 @@
+#include "boost/segmented_tree/seq.hpp"
+#include "churn.hpp"
+
+template <typename T>
+using Container = boost::segmented_tree::seq<T>;
+
+int main(int argc, char** argv) {
+  return bench_churn<Container, std::uint8_t>(argc, argv);
+}
@@ -0,0 +1,11 @@
+#include "boost/segmented_tree/huge_page_allocator.hpp"
+#include "boost/segmented_tree/seq.hpp"
+#include "range.hpp"
+
+template <typename T>
+using Container = boost::segmented_tree::seq<
+    T, boost::segmented_tree::huge_page_allocator<T>>;
+
+int main(int argc, char** argv) {
+  return bench_range<Container, std::uint64_t>(argc, argv);
+}
@@ -0,0 +1,66 @@
+#ifndef BENCH_RECORD
+#define BENCH_RECORD
+
+#include <boost/lexical_cast.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include "../common/single.hpp"
+#include "common.hpp"
+
+// A record of Size bytes identified by its key.
+template <std::size_t Size>
+struct record {
+  std::uint64_t key;
+  unsigned char payload[Size - sizeof(std::uint64_t)];
+
+  record(std::uint64_t k) : key{k}, payload{} {}
+};
+
+template <template <typename T> class Container, std::size_t Size>
+int bench_record(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <count> <seed>\n";
+    return EXIT_FAILURE;
+  }
+
+  auto count = boost::lexical_cast<std::size_t>(argv[1]);
+  auto seed = boost::lexical_cast<std::uint32_t>(argv[2]);
+  if (count == 0) {
+    std::cerr << "count must not be 0\n";
+    return EXIT_FAILURE;
+  }
+
+  auto data = make_insertion_data_single<std::uint64_t>(count, seed);
+  Container<record<Size>> container;
+  bench("Insert values", [&] {
+    for (std::size_t i = 0; i != count; ++i)
+      container.insert(nth(container, data.indexes[i]),
+                       record<Size>{data.ordered[i]});
+  });
+
+  std::vector<std::uint64_t> keys;
+  for (auto const& element : container) keys.push_back(element.key);
+  std::uint64_t expected = 0;
+  for (auto key : keys) expected += key;
+  verify(expected, bench("Accumulate forward", [&] {
+           std::uint64_t sum = 0;
+           for (auto const& element : container) sum += element.key;
+           return sum;
+         }));
+
+  expected = 0;
+  for (std::size_t i = 0; i != count; ++i) expected += keys[data.indexes[i]];
+  verify(expected, bench("Random access", [&] {
+           std::uint64_t sum = 0;
+           for (std::size_t i = 0; i != count; ++i)
+             sum += nth(container, data.indexes[i])->key;
+           return sum;
+         }));
+
+  bench("Erase values", [&] { erase_single(container, data); });
+  verify(container.size(), std::size_t{1});
+  verify(container.front().key, data.ordered[0]);
+  return EXIT_SUCCESS;
+}
+
+#endif  // #ifndef BENCH_RECORD
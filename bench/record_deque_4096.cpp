@@ -0,0 +1,9 @@
+#include <deque>
+#include "record.hpp"
+
+template <typename T>
+using Container = std::deque<T>;
+
+int main(int argc, char** argv) {
+  return bench_record<Container, 4096>(argc, argv);
+}
@@ -0,0 +1,9 @@
+#include "boost/segmented_tree/seq.hpp"
+#include "record.hpp"
+
+template <typename T>
+using Container = boost::segmented_tree::seq<T>;
+
+int main(int argc, char** argv) {
+  return bench_record<Container, 256>(argc, argv);
+}
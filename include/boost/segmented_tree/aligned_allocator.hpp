@@ -0,0 +1,86 @@
+// (C) Copyright Chris Clearwater 2014-2015. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy
+// at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BOOST_SEGMENTED_TREE_ALIGNED_ALLOCATOR
+#define BOOST_SEGMENTED_TREE_ALIGNED_ALLOCATOR
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace boost {
+namespace segmented_tree {
+
+/// An allocator whose blocks start on Alignment byte boundaries, a cache line
+/// by default, so that a segment spans as few lines as its size allows.
+///
+/// seq reads the alignment member and also starts the sizes and pointers
+/// arrays of its nodes on such a boundary, up to 64 bytes. Each block costs
+/// Alignment bytes more than requested, which hold the address to free.
+///
+/// \tparam T The type of the element to be allocated.
+/// \tparam Alignment The alignment of every block, a power of two.
+template <typename T, std::size_t Alignment = 64>
+class aligned_allocator {
+ private:
+  static_assert(Alignment != 0 && (Alignment & (Alignment - 1)) == 0,
+                "Alignment must be a power of two");
+
+ public:
+  /// The allocated type.
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = aligned_allocator<U, Alignment>;
+  };
+
+  /// The alignment of every block returned by allocate().
+  static constexpr std::size_t alignment =
+      Alignment > alignof(T) ? Alignment
+                             : alignof(T) > sizeof(void*) ? alignof(T)
+                                                          : sizeof(void*);
+
+  aligned_allocator() noexcept = default;
+
+  template <typename U>
+  aligned_allocator(aligned_allocator<U, Alignment> const&) noexcept {}
+
+  /// \par Returns
+  ///   A pointer to storage for n objects of type T, aligned to alignment.
+  T* allocate(std::size_t n) {
+    if (n > (static_cast<std::size_t>(-1) - alignment) / sizeof(T))
+      throw std::bad_alloc();
+    auto raw = static_cast<char*>(::operator new(n * sizeof(T) + alignment));
+    // The address to free goes in the word in front of the block, so the block
+    // starts at least one word in.
+    auto address = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+    auto shift = (alignment - address % alignment) % alignment;
+    auto block = raw + sizeof(void*) + shift;
+    reinterpret_cast<void**>(block)[-1] = raw;
+    return reinterpret_cast<T*>(block);
+  }
+
+  /// \par Effects
+  ///   Frees the storage pointed to by p.
+  void deallocate(T* p, std::size_t) noexcept {
+    ::operator delete(reinterpret_cast<void**>(p)[-1]);
+  }
+};
+
+template <typename T, typename U, std::size_t Alignment>
+inline bool operator==(aligned_allocator<T, Alignment> const&,
+                       aligned_allocator<U, Alignment> const&) noexcept {
+  return true;
+}
+
+template <typename T, typename U, std::size_t Alignment>
+inline bool operator!=(aligned_allocator<T, Alignment> const&,
+                       aligned_allocator<U, Alignment> const&) noexcept {
+  return false;
+}
+}
+}
+
+#endif  // #ifndef BOOST_SEGMENTED_TREE_ALIGNED_ALLOCATOR
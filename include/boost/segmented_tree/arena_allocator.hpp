@@ -0,0 +1,354 @@
+// (C) Copyright Chris Clearwater 2014-2015. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy
+// at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BOOST_SEGMENTED_TREE_ARENA_ALLOCATOR
+#define BOOST_SEGMENTED_TREE_ARENA_ALLOCATOR
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace boost {
+namespace segmented_tree {
+
+#ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+namespace detail {
+// The free lists a thread keeps for the arena it used last. Blocks cached for
+// another arena are abandoned rather than returned, so a thread never touches
+// memory of an arena that may already be released.
+struct arena_thread_cache {
+  static constexpr std::size_t classes = 4;
+
+  std::uint64_t owner{0};
+  std::array<std::size_t, classes> sizes{};
+  std::array<void*, classes> heads{};
+  std::array<std::size_t, classes> counts{};
+};
+
+inline arena_thread_cache& thread_cache() {
+  static thread_local arena_thread_cache cache;
+  return cache;
+}
+
+inline std::uint64_t next_arena_id() {
+  static std::atomic<std::uint64_t> id{0};
+  return ++id;
+}
+
+constexpr std::size_t huge_page_size = std::size_t{1} << 21;
+
+// Maps bytes, a multiple of huge_page_size, starting on a huge page boundary,
+// which the kernel needs to back the range with huge pages. Falls back to the
+// global operator new where there is no mmap.
+inline void* map_huge_pages(std::size_t bytes) {
+#if defined(MAP_ANONYMOUS)
+  auto size = bytes + huge_page_size;
+  auto pointer = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pointer == MAP_FAILED) throw std::bad_alloc();
+
+  // Trim the head and tail left over from aligning the start.
+  auto address = reinterpret_cast<std::uintptr_t>(pointer);
+  auto start = (address + huge_page_size - 1) & ~(huge_page_size - 1);
+  if (start != address) ::munmap(pointer, start - address);
+  if (start + bytes != address + size)
+    ::munmap(reinterpret_cast<void*>(start + bytes),
+             address + size - start - bytes);
+#if defined(MADV_HUGEPAGE)
+  ::madvise(reinterpret_cast<void*>(start), bytes, MADV_HUGEPAGE);
+#endif
+  return reinterpret_cast<void*>(start);
+#else
+  return ::operator new(bytes);
+#endif
+}
+
+inline void unmap_huge_pages(void* pointer, std::size_t bytes) noexcept {
+#if defined(MAP_ANONYMOUS)
+  ::munmap(pointer, bytes);
+#else
+  static_cast<void>(bytes);
+  ::operator delete(pointer);
+#endif
+}
+}
+#endif  // #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+
+/// A memory arena shared by many containers.
+///
+/// Memory is carved from large chunks and freed blocks are recycled through
+/// free lists kept per block size. seq only ever requests a few sizes, one for
+/// segments, one for each kind of index node and one for each capacity a lone
+/// root segment grows through, so every freed block is reused by the next
+/// request of the same kind. release() frees all chunks at
+/// once without visiting individual blocks.
+///
+/// An arena may be shared between threads. Optionally each thread keeps a
+/// small cache of freed blocks so that most requests don't take the lock. A
+/// thread caches blocks for one arena at a time; switching arenas abandons the
+/// cached blocks until the arena they came from is released.
+class arena {
+ private:
+  static constexpr std::size_t alignment = alignof(std::max_align_t);
+  static constexpr std::size_t classes = 16;
+
+  struct chunk {
+    chunk* next;
+    std::size_t size;
+  };
+
+  static constexpr std::size_t header_size() {
+    return (sizeof(chunk) + alignment - 1) / alignment * alignment;
+  }
+
+  static std::size_t round_up(std::size_t bytes) {
+    if (bytes == 0) return alignment;
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+  static void*& next_of(void* block) { return *static_cast<void**>(block); }
+
+  std::mutex mutex_;
+  chunk* chunks_{nullptr};
+  char* cursor_{nullptr};
+  char* end_{nullptr};
+  std::array<std::size_t, classes> sizes_{};
+  std::array<void*, classes> heads_{};
+  std::size_t chunk_size_;
+  std::size_t thread_cache_size_;
+  bool huge_pages_;
+  std::uint64_t id_{detail::next_arena_id()};
+
+  // Returns the free list for bytes, or nullptr if the size class table is
+  // full. Blocks of such sizes are only reclaimed by release().
+  void** free_list(std::size_t bytes) {
+    for (std::size_t i = 0; i != classes; ++i) {
+      if (sizes_[i] == bytes) return &heads_[i];
+      if (sizes_[i] == 0) {
+        sizes_[i] = bytes;
+        return &heads_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  static std::size_t round_up_pages(std::size_t bytes) {
+    return (bytes + detail::huge_page_size - 1) / detail::huge_page_size *
+           detail::huge_page_size;
+  }
+
+  void* allocate_chunk(std::size_t bytes) {
+    auto size = header_size() + bytes;
+    if (huge_pages_) size = round_up_pages(size);
+    auto pointer = static_cast<chunk*>(huge_pages_
+                                           ? detail::map_huge_pages(size)
+                                           : ::operator new(size));
+    pointer->next = chunks_;
+    pointer->size = size;
+    chunks_ = pointer;
+    return reinterpret_cast<char*>(pointer) + header_size();
+  }
+
+  void* allocate_locked(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto list = free_list(bytes);
+    if (list != nullptr && *list != nullptr) {
+      auto block = *list;
+      *list = next_of(block);
+      return block;
+    }
+
+    if (bytes > chunk_size_) return allocate_chunk(bytes);
+
+    if (static_cast<std::size_t>(end_ - cursor_) < bytes) {
+      cursor_ = static_cast<char*>(allocate_chunk(chunk_size_));
+      end_ = cursor_ + chunk_size_;
+    }
+
+    auto block = cursor_;
+    cursor_ += bytes;
+    return block;
+  }
+
+  void deallocate_locked(void* block, std::size_t bytes) noexcept {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto list = free_list(bytes);
+    if (list == nullptr) return;
+    next_of(block) = *list;
+    *list = block;
+  }
+
+ public:
+  /// \par Effects
+  ///   Constructs an empty arena that carves blocks from chunks of chunk_size
+  ///   bytes. If thread_cache_size is not 0, each thread keeps up to that many
+  ///   freed blocks of each size for reuse without locking. If huge_pages is
+  ///   true, chunks are mapped directly from the operating system in whole 2
+  ///   MiB pages, and the kernel is asked to back them with transparent huge
+  ///   pages, which cuts TLB misses when the blocks span gigabytes. Chunks
+  ///   then span whole pages, their header included.
+  explicit arena(std::size_t chunk_size = std::size_t{1} << 20,
+                 std::size_t thread_cache_size = 0, bool huge_pages = false)
+      : chunk_size_{huge_pages ? round_up_pages(round_up(chunk_size)) -
+                                     header_size()
+                               : round_up(chunk_size)},
+        thread_cache_size_{thread_cache_size},
+        huge_pages_{huge_pages} {}
+
+  arena(arena const&) = delete;
+  arena& operator=(arena const&) = delete;
+
+  /// \par Effects
+  ///   Releases all memory owned by the arena.
+  ~arena() { release(); }
+
+  /// \par Returns
+  ///   A block of at least bytes bytes aligned for any fundamental type.
+  ///
+  /// \par Throws
+  ///   std::bad_alloc if a new chunk can't be allocated.
+  void* allocate(std::size_t bytes) {
+    bytes = round_up(bytes);
+
+    if (thread_cache_size_ != 0) {
+      auto& cache = detail::thread_cache();
+      if (cache.owner == id_) {
+        for (std::size_t i = 0; i != cache.classes; ++i) {
+          if (cache.sizes[i] != bytes || cache.counts[i] == 0) continue;
+          auto block = cache.heads[i];
+          cache.heads[i] = next_of(block);
+          --cache.counts[i];
+          return block;
+        }
+      }
+    }
+
+    return allocate_locked(bytes);
+  }
+
+  /// \par Effects
+  ///   Returns a block obtained from allocate(bytes) to the arena.
+  void deallocate(void* block, std::size_t bytes) noexcept {
+    bytes = round_up(bytes);
+
+    if (thread_cache_size_ != 0) {
+      auto& cache = detail::thread_cache();
+      if (cache.owner != id_) cache = detail::arena_thread_cache{};
+      cache.owner = id_;
+      for (std::size_t i = 0; i != cache.classes; ++i) {
+        if (cache.sizes[i] == 0) cache.sizes[i] = bytes;
+        if (cache.sizes[i] != bytes) continue;
+        if (cache.counts[i] == thread_cache_size_) break;
+        next_of(block) = cache.heads[i];
+        cache.heads[i] = block;
+        ++cache.counts[i];
+        return;
+      }
+    }
+
+    deallocate_locked(block, bytes);
+  }
+
+  /// \par Effects
+  ///   Frees every chunk of the arena at once, invalidating all blocks
+  ///   allocated from it.
+  ///
+  /// \par Complexity
+  ///   Linear in the number of chunks, independent of the number of blocks.
+  ///
+  /// \par Note
+  ///   Containers still holding memory from the arena must not be used or
+  ///   destroyed afterwards. Blocks cached by other threads are abandoned.
+  ///   Must not run concurrently with other operations on the arena.
+  void release() noexcept {
+    while (chunks_ != nullptr) {
+      auto next = chunks_->next;
+      if (huge_pages_)
+        detail::unmap_huge_pages(chunks_, chunks_->size);
+      else
+        ::operator delete(chunks_);
+      chunks_ = next;
+    }
+    cursor_ = nullptr;
+    end_ = nullptr;
+    sizes_.fill(0);
+    heads_.fill(nullptr);
+    id_ = detail::next_arena_id();
+  }
+
+  /// \par Returns
+  ///   The size in bytes of the chunks blocks are carved from.
+  std::size_t chunk_size() const noexcept { return chunk_size_; }
+
+  /// \par Returns
+  ///   Whether chunks are mapped in huge pages.
+  bool huge_pages() const noexcept { return huge_pages_; }
+};
+
+/// An allocator drawing from an arena, meant to be shared by many seq
+/// instances. Copies and rebinds refer to the same arena and compare equal.
+///
+/// \tparam T The type of the element to be allocated.
+template <typename T>
+class arena_allocator {
+ private:
+  template <typename>
+  friend class arena_allocator;
+  arena* arena_;
+
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "arena_allocator cannot satisfy the alignment of T");
+
+ public:
+  /// The allocated type.
+  using value_type = T;
+
+  /// \par Effects
+  ///   Constructs an allocator drawing from a.
+  arena_allocator(arena& a) noexcept : arena_{&a} {}
+
+  template <typename U>
+  arena_allocator(arena_allocator<U> const& other) noexcept
+      : arena_{other.arena_} {}
+
+  /// \par Returns
+  ///   A pointer to storage for n objects of type T.
+  T* allocate(std::size_t n) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T)) throw std::bad_alloc();
+    return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+  }
+
+  /// \par Effects
+  ///   Returns the storage of n objects pointed to by p to the arena.
+  void deallocate(T* p, std::size_t n) noexcept {
+    arena_->deallocate(p, n * sizeof(T));
+  }
+
+  /// \par Returns
+  ///   The arena memory is drawn from.
+  arena& resource() const noexcept { return *arena_; }
+};
+
+template <typename T, typename U>
+inline bool operator==(arena_allocator<T> const& a,
+                       arena_allocator<U> const& b) noexcept {
+  return &a.resource() == &b.resource();
+}
+
+template <typename T, typename U>
+inline bool operator!=(arena_allocator<T> const& a,
+                       arena_allocator<U> const& b) noexcept {
+  return !(a == b);
+}
+}
+}
+
+#endif  // #ifndef BOOST_SEGMENTED_TREE_ARENA_ALLOCATOR
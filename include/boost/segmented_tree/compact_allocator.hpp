@@ -0,0 +1,426 @@
+// (C) Copyright Chris Clearwater 2014-2015. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy
+// at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BOOST_SEGMENTED_TREE_COMPACT_ALLOCATOR
+#define BOOST_SEGMENTED_TREE_COMPACT_ALLOCATOR
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+namespace boost {
+namespace segmented_tree {
+
+template <typename T>
+class compact_pointer;
+
+template <typename T>
+class compact_allocator;
+
+#ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+namespace detail {
+template <typename From, typename To>
+struct is_static_castable {
+ private:
+  template <typename F, typename T>
+  static auto test(F from) -> decltype(static_cast<T>(from), std::true_type{});
+  template <typename, typename>
+  static std::false_type test(...);
+
+ public:
+  static bool constexpr value =
+      decltype(test<From, To>(std::declval<From>()))::value;
+};
+
+// A process wide arena addressed by 32-bit byte offsets. Memory is carved
+// from 1 MiB chunks and freed blocks are recycled through per size free lists
+// threaded through the blocks themselves. Chunks are never returned, so an
+// offset stays valid for as long as the block it names is allocated.
+//
+// All state is constant initialized, so pointers can be used from static
+// initializers and destructors regardless of translation unit order.
+template <typename = void>
+struct compact_arena {
+  static constexpr std::size_t chunk_bits = 20;
+  static constexpr std::size_t chunk_size = std::size_t{1} << chunk_bits;
+  static constexpr std::size_t chunk_count = std::size_t{1}
+                                             << (32 - chunk_bits);
+  static constexpr std::size_t granularity = 16;
+
+  static char* chunks[chunk_count];
+  static std::uint32_t free_lists[chunk_size / granularity + 1];
+  static std::size_t length;
+  static std::size_t used;
+  static std::mutex mutex;
+
+  static char* address(std::uint32_t offset) {
+    return chunks[offset >> chunk_bits] + (offset & (chunk_size - 1));
+  }
+
+  static std::size_t round_up(std::size_t bytes) {
+    return (bytes + granularity - 1) / granularity * granularity;
+  }
+
+  static std::uint32_t allocate(std::size_t bytes) {
+    bytes = round_up(bytes);
+    if (bytes == 0) bytes = granularity;
+    if (bytes > chunk_size) throw std::bad_alloc();
+
+    std::lock_guard<std::mutex> lock{mutex};
+    auto& head = free_lists[bytes / granularity];
+    if (head != 0) {
+      auto offset = head;
+      std::memcpy(&head, address(offset), sizeof(head));
+      return offset;
+    }
+
+    if (length == 0 || chunk_size - used < bytes) {
+      if (length == chunk_count) throw std::bad_alloc();
+      chunks[length] = static_cast<char*>(::operator new(chunk_size));
+      // Offset 0 is reserved for the null pointer.
+      used = length == 0 ? granularity : 0;
+      ++length;
+    }
+
+    auto offset = static_cast<std::uint32_t>(((length - 1) << chunk_bits) + used);
+    used += bytes;
+    return offset;
+  }
+
+  static void deallocate(std::uint32_t offset, std::size_t bytes) {
+    bytes = round_up(bytes);
+    if (bytes == 0) bytes = granularity;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    auto& head = free_lists[bytes / granularity];
+    std::memcpy(address(offset), &head, sizeof(head));
+    head = offset;
+  }
+
+  static std::uint32_t offset_of(void const* pointer) {
+    auto bytes = static_cast<char const*>(pointer);
+    std::lock_guard<std::mutex> lock{mutex};
+    for (std::size_t i = 0; i != length; ++i) {
+      if (bytes >= chunks[i] && bytes < chunks[i] + chunk_size)
+        return static_cast<std::uint32_t>((i << chunk_bits) +
+                                          (bytes - chunks[i]));
+    }
+    return 0;
+  }
+};
+
+template <typename D>
+char* compact_arena<D>::chunks[compact_arena<D>::chunk_count];
+
+template <typename D>
+std::uint32_t compact_arena<D>::free_lists[compact_arena<D>::chunk_size /
+                                               compact_arena<D>::granularity +
+                                           1];
+
+template <typename D>
+std::size_t compact_arena<D>::length;
+
+template <typename D>
+std::size_t compact_arena<D>::used;
+
+template <typename D>
+std::mutex compact_arena<D>::mutex;
+
+struct compact_nat {};
+}
+#endif  // #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+
+/// A 32-bit fancy pointer into the arena shared by all compact_allocator
+/// instances.
+///
+/// \tparam T The pointed to type, possibly cv-qualified or void.
+template <typename T>
+class compact_pointer {
+ private:
+  template <typename>
+  friend class compact_pointer;
+  template <typename>
+  friend class compact_allocator;
+  using arena = detail::compact_arena<>;
+
+  std::uint32_t offset_{0};
+
+  template <typename U>
+  static std::uint32_t convert(compact_pointer<U> const& other,
+                               std::true_type) {
+    return other.offset_;
+  }
+
+  // Derived to base conversions may adjust the address.
+  template <typename U>
+  static std::uint32_t convert(compact_pointer<U> const& other,
+                               std::false_type) {
+    if (other.offset_ == 0) return 0;
+    auto from = other.get();
+    auto to = static_cast<T*>(from);
+    return static_cast<std::uint32_t>(
+        other.offset_ + (reinterpret_cast<char const volatile*>(to) -
+                         reinterpret_cast<char const volatile*>(from)));
+  }
+
+  template <typename U>
+  static std::uint32_t convert(compact_pointer<U> const& other) {
+    using plain_t = typename std::remove_cv<T>::type;
+    using plain_u = typename std::remove_cv<U>::type;
+    return convert(other,
+                   std::integral_constant<
+                       bool, std::is_void<plain_t>::value ||
+                                 std::is_void<plain_u>::value ||
+                                 std::is_same<plain_t, plain_u>::value>{});
+  }
+
+  static constexpr std::size_t stride() {
+    return sizeof(typename std::conditional<std::is_void<T>::value, char,
+                                            T>::type);
+  }
+
+ public:
+  /// The pointed to type.
+  using element_type = T;
+  /// The value type.
+  using value_type = typename std::remove_cv<T>::type;
+  /// The difference type.
+  using difference_type = std::ptrdiff_t;
+  /// The reference type.
+  using reference = typename std::add_lvalue_reference<T>::type;
+  /// The pointer type.
+  using pointer = compact_pointer;
+  /// The iterator category.
+  using iterator_category = std::random_access_iterator_tag;
+  /// Rebinds to a pointer to another type.
+  template <typename U>
+  using rebind = compact_pointer<U>;
+
+  /// \par Effects
+  ///   Constructs a null pointer.
+  compact_pointer() noexcept = default;
+
+  /// \par Effects
+  ///   Constructs a null pointer.
+  compact_pointer(std::nullptr_t) noexcept {}
+
+  /// \par Effects
+  ///   Converts from a pointer to a type implicitly convertible to T.
+  template <typename U, typename std::enable_if<
+                            std::is_convertible<U*, T*>::value, int>::type = 0>
+  compact_pointer(compact_pointer<U> const& other) noexcept
+      : offset_{convert(other)} {}
+
+  /// \par Effects
+  ///   Converts from a pointer to a type that can be static_cast to T.
+  template <typename U,
+            typename std::enable_if<
+                !std::is_convertible<U*, T*>::value &&
+                    detail::is_static_castable<U*, T*>::value,
+                int>::type = 0>
+  explicit compact_pointer(compact_pointer<U> const& other) noexcept
+      : offset_{convert(other)} {}
+
+  /// \par Returns
+  ///   A compact pointer to r, which must live in the arena.
+  ///
+  /// \par Complexity
+  ///   Linear in the number of arena chunks.
+  static compact_pointer pointer_to(
+      typename std::conditional<std::is_void<T>::value, detail::compact_nat,
+                                T>::type& r) noexcept {
+    compact_pointer result;
+    result.offset_ = arena::offset_of(std::addressof(r));
+    return result;
+  }
+
+  /// \par Returns
+  ///   The raw pointer.
+  T* get() const noexcept {
+    return offset_ == 0 ? nullptr
+                        : reinterpret_cast<T*>(arena::address(offset_));
+  }
+
+  /// \par Returns
+  ///   True if not null.
+  explicit operator bool() const noexcept { return offset_ != 0; }
+
+  reference operator*() const { return *get(); }
+
+  T* operator->() const noexcept { return get(); }
+
+  reference operator[](difference_type diff) const { return *(*this + diff); }
+
+  compact_pointer& operator+=(difference_type diff) noexcept {
+    offset_ += static_cast<std::uint32_t>(diff * stride());
+    return *this;
+  }
+
+  compact_pointer& operator-=(difference_type diff) noexcept {
+    offset_ -= static_cast<std::uint32_t>(diff * stride());
+    return *this;
+  }
+
+  compact_pointer& operator++() noexcept { return *this += 1; }
+
+  compact_pointer& operator--() noexcept { return *this -= 1; }
+
+  compact_pointer operator++(int) noexcept {
+    auto copy = *this;
+    ++*this;
+    return copy;
+  }
+
+  compact_pointer operator--(int) noexcept {
+    auto copy = *this;
+    --*this;
+    return copy;
+  }
+
+  friend compact_pointer operator+(compact_pointer p,
+                                   difference_type diff) noexcept {
+    return p += diff;
+  }
+
+  friend compact_pointer operator+(difference_type diff,
+                                   compact_pointer p) noexcept {
+    return p += diff;
+  }
+
+  friend compact_pointer operator-(compact_pointer p,
+                                   difference_type diff) noexcept {
+    return p -= diff;
+  }
+
+  friend difference_type operator-(compact_pointer a,
+                                   compact_pointer b) noexcept {
+    return (static_cast<difference_type>(a.offset_) -
+            static_cast<difference_type>(b.offset_)) /
+           static_cast<difference_type>(stride());
+  }
+
+  friend bool operator==(compact_pointer a, compact_pointer b) noexcept {
+    return a.offset_ == b.offset_;
+  }
+
+  friend bool operator!=(compact_pointer a, compact_pointer b) noexcept {
+    return a.offset_ != b.offset_;
+  }
+
+  friend bool operator<(compact_pointer a, compact_pointer b) noexcept {
+    return a.offset_ < b.offset_;
+  }
+
+  friend bool operator>(compact_pointer a, compact_pointer b) noexcept {
+    return a.offset_ > b.offset_;
+  }
+
+  friend bool operator<=(compact_pointer a, compact_pointer b) noexcept {
+    return a.offset_ <= b.offset_;
+  }
+
+  friend bool operator>=(compact_pointer a, compact_pointer b) noexcept {
+    return a.offset_ >= b.offset_;
+  }
+
+  friend bool operator==(compact_pointer a, std::nullptr_t) noexcept {
+    return a.offset_ == 0;
+  }
+
+  friend bool operator==(std::nullptr_t, compact_pointer a) noexcept {
+    return a.offset_ == 0;
+  }
+
+  friend bool operator!=(compact_pointer a, std::nullptr_t) noexcept {
+    return a.offset_ != 0;
+  }
+
+  friend bool operator!=(std::nullptr_t, compact_pointer a) noexcept {
+    return a.offset_ != 0;
+  }
+};
+
+/// An allocator for seq whose pointers and sizes are 32 bits wide.
+///
+/// All instances share one process wide arena of at most 4 GiB, addressed by
+/// 32-bit offsets. A seq using this allocator stores 4 byte child pointers and
+/// sizes in its index nodes, roughly doubling their fanout, and its iterators
+/// are half the size. The container must hold fewer than 2^32 elements.
+///
+/// \tparam T The type of the element to be allocated.
+template <typename T>
+class compact_allocator {
+ private:
+  using arena = detail::compact_arena<>;
+
+ public:
+  /// The allocated type.
+  using value_type = T;
+  /// The pointer type.
+  using pointer = compact_pointer<T>;
+  /// The const pointer type.
+  using const_pointer = compact_pointer<T const>;
+  /// The void pointer type.
+  using void_pointer = compact_pointer<void>;
+  /// The const void pointer type.
+  using const_void_pointer = compact_pointer<void const>;
+  /// The size type.
+  using size_type = std::uint32_t;
+  /// The difference type.
+  using difference_type = std::ptrdiff_t;
+
+  /// Rebinds to an allocator of another type.
+  template <typename U>
+  struct rebind {
+    using other = compact_allocator<U>;
+  };
+
+  static_assert(alignof(T) <= arena::granularity,
+                "compact_allocator cannot satisfy the alignment of T");
+
+  compact_allocator() noexcept = default;
+
+  template <typename U>
+  compact_allocator(compact_allocator<U> const&) noexcept {}
+
+  /// \par Returns
+  ///   A pointer to storage for n objects of type T.
+  ///
+  /// \par Throws
+  ///   std::bad_alloc if the storage exceeds an arena chunk or the arena is
+  ///   exhausted.
+  pointer allocate(size_type n) {
+    if (n > arena::chunk_size / sizeof(T)) throw std::bad_alloc();
+    pointer result;
+    result.offset_ = arena::allocate(n * sizeof(T));
+    return result;
+  }
+
+  /// \par Effects
+  ///   Returns the storage of n objects pointed to by p to the arena.
+  void deallocate(pointer p, size_type n) noexcept {
+    arena::deallocate(p.offset_, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+inline bool operator==(compact_allocator<T> const&,
+                       compact_allocator<U> const&) noexcept {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(compact_allocator<T> const&,
+                       compact_allocator<U> const&) noexcept {
+  return false;
+}
+}
+}
+
+#endif  // #ifndef BOOST_SEGMENTED_TREE_COMPACT_ALLOCATOR
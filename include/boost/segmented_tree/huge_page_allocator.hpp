@@ -0,0 +1,82 @@
+// (C) Copyright Chris Clearwater 2014-2015. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy
+// at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BOOST_SEGMENTED_TREE_HUGE_PAGE_ALLOCATOR
+#define BOOST_SEGMENTED_TREE_HUGE_PAGE_ALLOCATOR
+
+#include <boost/segmented_tree/arena_allocator.hpp>
+#include <cstddef>
+#include <new>
+
+namespace boost {
+namespace segmented_tree {
+
+#ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+namespace detail {
+// Never destroyed, so sequences in static storage can free their blocks at
+// exit regardless of destruction order.
+inline arena& huge_page_arena() {
+  static arena* instance = new arena{huge_page_size, 0, true};
+  return *instance;
+}
+}
+#endif  // #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+
+/// An allocator drawing from a process wide arena of 2 MiB regions mapped
+/// from the operating system and advised to be backed by transparent huge
+/// pages. Segments and nodes then share a few TLB entries per 2 MiB instead
+/// of one per 4 KiB page, which speeds up random access into sequences whose
+/// blocks span gigabytes. Freed blocks are reused for later requests of the
+/// same size; the regions are never returned to the operating system.
+///
+/// Huge pages are used where the kernel supports them for mappings that ask
+/// for them, on Linux when /sys/kernel/mm/transparent_hugepage/enabled is
+/// madvise or always. Elsewhere the regions are plain pages or come from the
+/// global operator new.
+///
+/// \tparam T The type of the element to be allocated.
+template <typename T>
+class huge_page_allocator {
+ private:
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "huge_page_allocator cannot satisfy the alignment of T");
+
+ public:
+  /// The allocated type.
+  using value_type = T;
+
+  huge_page_allocator() noexcept = default;
+
+  template <typename U>
+  huge_page_allocator(huge_page_allocator<U> const&) noexcept {}
+
+  /// \par Returns
+  ///   A pointer to storage for n objects of type T.
+  T* allocate(std::size_t n) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T)) throw std::bad_alloc();
+    return static_cast<T*>(detail::huge_page_arena().allocate(n * sizeof(T)));
+  }
+
+  /// \par Effects
+  ///   Returns the storage of n objects pointed to by p for reuse.
+  void deallocate(T* p, std::size_t n) noexcept {
+    detail::huge_page_arena().deallocate(p, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+inline bool operator==(huge_page_allocator<T> const&,
+                       huge_page_allocator<U> const&) noexcept {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(huge_page_allocator<T> const&,
+                       huge_page_allocator<U> const&) noexcept {
+  return false;
+}
+}
+}
+
+#endif  // #ifndef BOOST_SEGMENTED_TREE_HUGE_PAGE_ALLOCATOR
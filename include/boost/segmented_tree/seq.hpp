@@ -9,9 +9,13 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <limits>
+#include <map>
+#include <stdexcept>
 #include <type_traits>
 #include <utility>
 
@@ -19,9 +23,96 @@
 #include <iostream>
 #endif
 
+/// The number of segments ahead of the current one that iterators prefetch
+/// while stepping forward or backward. Define it to 0 to disable prefetching.
+#ifndef BOOST_SEGMENTED_TREE_PREFETCH_DISTANCE
+#define BOOST_SEGMENTED_TREE_PREFETCH_DISTANCE 1
+#endif
+
+/// The default number of freed segments, leaves and index nodes of each kind
+/// that a seq keeps for reuse. See seq::cache_limit.
+#ifndef BOOST_SEGMENTED_TREE_CACHE_LIMIT
+#define BOOST_SEGMENTED_TREE_CACHE_LIMIT 4
+#endif
+
+/// Whether a full segment, leaf or index node passes elements to a sibling with
+/// room before splitting. Define it to 0 to always split in half.
+#ifndef BOOST_SEGMENTED_TREE_REDISTRIBUTE
+#define BOOST_SEGMENTED_TREE_REDISTRIBUTE 1
+#endif
+
+/// Whether a block that fills up at its back keeps all but the minimum number
+/// of children when it splits, so appending leaves full blocks behind. Define
+/// it to 0 to always split in half.
+#ifndef BOOST_SEGMENTED_TREE_EDGE_SPLIT
+#define BOOST_SEGMENTED_TREE_EDGE_SPLIT 1
+#endif
+
+/// Whether segments, leaves and index nodes other than the root may shrink to
+/// a third of their capacity before they merge, instead of half. Define it to 0
+/// to merge at half, which bounds memory use tighter but lets a block that
+/// merged full split again on the next insertion.
+#ifndef BOOST_SEGMENTED_TREE_HYSTERESIS
+#define BOOST_SEGMENTED_TREE_HYSTERESIS 1
+#endif
+
+/// Whether the elements of a segment may start anywhere within its block, so
+/// that insertions and erasures move the elements on the shorter side of the
+/// position. Leaf nodes then record where each of their segments starts.
+/// Define it to 0 to keep elements at the front of their block.
+#ifndef BOOST_SEGMENTED_TREE_FLOATING_SEGMENTS
+#define BOOST_SEGMENTED_TREE_FLOATING_SEGMENTS 1
+#endif
+
+/// The fewest elements a segment holds when its element type is too large for
+/// segment_target to fit that many. Such elements then share segments instead
+/// of taking an allocation and a leaf slot each. Define it to 1 to size
+/// segments by segment_target alone.
+#ifndef BOOST_SEGMENTED_TREE_MIN_SEGMENT_LENGTH
+#define BOOST_SEGMENTED_TREE_MIN_SEGMENT_LENGTH 2
+#endif
+
+/// Whether each seq may hold fewer elements per segment than segment_target
+/// allows, as set by seq::segment_limit. Define it to 1 to enable it, at the
+/// cost of reading the limit from the sequence instead of folding it into the
+/// code.
+#ifndef BOOST_SEGMENTED_TREE_RUNTIME_GEOMETRY
+#define BOOST_SEGMENTED_TREE_RUNTIME_GEOMETRY 0
+#endif
+
+/// The number of elements the root segment of a new sequence is allocated for.
+/// The root doubles its capacity whenever it overflows, until it is a full
+/// segment. Define it to 0 to allocate full segments from the start.
+#ifndef BOOST_SEGMENTED_TREE_ROOT_CAPACITY
+#define BOOST_SEGMENTED_TREE_ROOT_CAPACITY 8
+#endif
+
+/// Whether every segment records the leaf and slot holding it, as index nodes
+/// do, so that seq::iterator_to finds an element from its address. Define it
+/// to 1 to enable it, at the cost of room for the record in front of every
+/// segment, a write to it whenever the segment changes slot, and an ordered
+/// index of the segments' blocks in each sequence.
+#ifndef BOOST_SEGMENTED_TREE_BACK_POINTERS
+#define BOOST_SEGMENTED_TREE_BACK_POINTERS 0
+#endif
+
 namespace boost {
 namespace segmented_tree {
 
+/// Whether an object of type T may be moved to another address by copying its
+/// bytes, which ends the lifetime of the original without running its
+/// destructor. seq then shifts, splits, merges and compacts segments with
+/// memmove instead of move constructors, assignments and destructors.
+///
+/// Defaults to std::is_trivially_copyable<T>. Specialize it as
+/// std::true_type for types that hold no pointers into themselves, such as
+/// std::unique_ptr or most handle types. std::string qualifies with libc++ but
+/// not with libstdc++, whose short strings point into their own object.
+///
+/// \tparam T The element type.
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
 #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
 namespace detail {
 namespace is_nothrow_swappable_impl {
@@ -54,13 +145,96 @@ struct is_alloc_move_construct_default {
       decltype(test<Alloc>(std::declval<Alloc>()))::value;
 };
 
+// The alignment an allocator promises for its blocks through a static
+// alignment member, or 0 if it promises none beyond that of the type.
+template <typename Alloc>
+struct allocator_alignment {
+ private:
+  template <typename U>
+  static std::integral_constant<std::size_t, U::alignment> test(int);
+  template <typename>
+  static std::integral_constant<std::size_t, 0> test(...);
+
+ public:
+  static std::size_t constexpr value = decltype(test<Alloc>(0))::value;
+};
+
+template <typename T, typename Alloc>
+struct is_alloc_destroy_default {
+ private:
+  template <typename U>
+  static auto test(U alloc)
+      -> decltype(alloc.destroy(std::declval<T*>()), std::false_type{});
+  template <typename>
+  static std::true_type test(...);
+
+ public:
+  static bool constexpr value =
+      decltype(test<Alloc>(std::declval<Alloc>()))::value;
+};
+
+// The blocks of a sequence's segments ordered by address, each mapped to the
+// number of bytes it spans, so that the block holding an element is found from
+// the element's address.
+template <bool Enabled>
+class segment_index {
+ private:
+  std::map<std::uintptr_t, std::size_t> blocks_;
+
+  static std::uintptr_t address(void const* pointer) {
+    return reinterpret_cast<std::uintptr_t>(pointer);
+  }
+
+ public:
+  void insert(void const* block, std::size_t bytes) {
+    blocks_.emplace(address(block), bytes);
+  }
+
+  void erase(void const* block) noexcept { blocks_.erase(address(block)); }
+
+  // Returns the start of the block holding element, or nullptr if there is
+  // none.
+  void const* find(void const* element) const noexcept {
+    auto it = blocks_.upper_bound(address(element));
+    if (it == blocks_.begin()) return nullptr;
+    --it;
+    if (address(element) - it->first >= it->second) return nullptr;
+    return reinterpret_cast<void const*>(it->first);
+  }
+
+  void clear() noexcept { blocks_.clear(); }
+
+  void swap(segment_index& other) noexcept { blocks_.swap(other.blocks_); }
+};
+
+template <>
+class segment_index<false> {
+ public:
+  void insert(void const*, std::size_t) {}
+  void erase(void const*) noexcept {}
+  void const* find(void const*) const noexcept { return nullptr; }
+  void clear() noexcept {}
+  void swap(segment_index&) noexcept {}
+};
+
+template <typename Pointer>
+inline void prefetch(Pointer pointer) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(static_cast<void const*>(std::addressof(*pointer)));
+#else
+  static_cast<void>(pointer);
+#endif
+}
+
 template <typename T, typename VoidPointer, typename SizeType,
-          std::size_t segment_target, std::size_t base_target>
+          std::size_t segment_target, std::size_t base_target,
+          std::size_t leaf_target, std::size_t alignment>
 struct static_traits_t {
   // forward declarations
   struct node_base;
-  struct node_data;
+  struct leaf_base;
   struct node;
+  struct leaf;
   struct segment_entry;
   struct leaf_entry;
   struct iterator_entry;
@@ -69,8 +243,12 @@ struct static_traits_t {
   using value_type = T;
   using void_pointer = VoidPointer;
   using size_type = SizeType;
+  using base_pointer =
+      typename std::pointer_traits<VoidPointer>::template rebind<node_base>;
   using node_pointer =
       typename std::pointer_traits<VoidPointer>::template rebind<node>;
+  using leaf_pointer =
+      typename std::pointer_traits<VoidPointer>::template rebind<leaf>;
   using element_pointer =
       typename std::pointer_traits<VoidPointer>::template rebind<value_type>;
   using difference_type =
@@ -79,74 +257,238 @@ struct static_traits_t {
   // sized types
   struct node_base {
     node_pointer parent_pointer;
-    std::uint16_t parent_index;
-    std::uint16_t length;
+    std::uint16_t parent_index_;
+    std::uint16_t length_;
+
+    size_type parent_index() { return parent_index_; }
+
+    void parent_index(size_type index) {
+      parent_index_ = static_cast<std::uint16_t>(index);
+    }
+
+    size_type length() { return length_; }
+
+    void length(size_type length) {
+      length_ = static_cast<std::uint16_t>(length);
+    }
   };
 
-  struct node_data {
-    void_pointer pointer;
-    size_type sz;
+  struct leaf_base : node_base {
+    // Siblings at height 2, regardless of which node they hang from.
+    leaf_pointer prev_pointer;
+    leaf_pointer next_pointer;
   };
 
   // constexpr
   static constexpr std::size_t segment_free() { return segment_target; }
 
-  static constexpr std::size_t node_size() { return sizeof(node_base); }
+  static constexpr std::size_t segment_fit() {
+    return segment_free() / sizeof(T);
+  }
+
+  static constexpr std::size_t segment_least() {
+    return BOOST_SEGMENTED_TREE_MIN_SEGMENT_LENGTH > 1
+               ? BOOST_SEGMENTED_TREE_MIN_SEGMENT_LENGTH
+               : 1;
+  }
+
+  static constexpr std::size_t segment_max() {
+    return segment_fit() > segment_least() ? segment_fit() : segment_least();
+  }
+
+  static constexpr bool hysteresis() {
+    return BOOST_SEGMENTED_TREE_HYSTERESIS != 0;
+  }
+
+  static constexpr bool runtime_geometry() {
+    return BOOST_SEGMENTED_TREE_RUNTIME_GEOMETRY != 0;
+  }
+
+  static constexpr bool back_pointers() {
+    return BOOST_SEGMENTED_TREE_BACK_POINTERS != 0;
+  }
+
+  static constexpr bool floating_segments() {
+    return BOOST_SEGMENTED_TREE_FLOATING_SEGMENTS != 0 && segment_max() > 1;
+  }
+
+  // The capacity of the root segment of a new tree, at most a full segment.
+  static constexpr std::size_t root_min() {
+    return BOOST_SEGMENTED_TREE_ROOT_CAPACITY == 0 ||
+                   BOOST_SEGMENTED_TREE_ROOT_CAPACITY > segment_max()
+               ? segment_max()
+               : BOOST_SEGMENTED_TREE_ROOT_CAPACITY;
+  }
+
+  // The fewest children a block other than the root keeps, but no fewer than
+  // least. Two blocks at the minimum always fit in one.
+  static constexpr std::size_t fill_min(std::size_t max, std::size_t least) {
+    return !hysteresis() ? (max + 1) / 2
+                         : (max + 2) / 3 > least ? (max + 2) / 3 : least;
+  }
+
+  static constexpr std::size_t segment_min() {
+    return fill_min(segment_max(), 1);
+  }
+
+  // A leaf child is a segment, so its size never exceeds segment_max().
+  using leaf_size_type = typename std::conditional<
+      segment_max() <= (std::numeric_limits<std::uint16_t>::max)(),
+      std::uint16_t,
+      typename std::conditional<
+          segment_max() <= (std::numeric_limits<std::uint32_t>::max)(),
+          std::uint32_t, size_type>::type>::type;
+
+  // When the allocator aligns its blocks, see aligned_allocator, the sizes and
+  // pointers arrays of nodes start on that alignment too, up to a cache line,
+  // so a search or update of either touches as few lines as it can. Below 16
+  // bytes there is nothing to gain.
+  static constexpr std::size_t line_alignment() {
+    return alignment < 16 ? 0 : alignment < 64 ? alignment : 64;
+  }
+
+  template <typename U>
+  static constexpr std::size_t array_alignment() {
+    return line_alignment() > alignof(U) ? line_alignment() : alignof(U);
+  }
+
+  // The most padding in front of each aligned array.
+  static constexpr std::size_t array_padding() {
+    return line_alignment() == 0 ? 0 : line_alignment() - 1;
+  }
+
+  static constexpr std::size_t node_size() {
+    return sizeof(node_base) + 2 * array_padding();
+  }
+
+  static constexpr std::size_t leaf_size() {
+    return sizeof(leaf_base) + 2 * array_padding();
+  }
 
   static constexpr std::size_t base_free() {
     return node_size() > base_target ? 0 : base_target - node_size();
   }
 
-  static constexpr std::size_t segment_fit() {
-    return segment_free() / sizeof(T);
+  static constexpr std::size_t leaf_free() {
+    return leaf_size() > leaf_target ? 0 : leaf_target - leaf_size();
   }
 
+  // Sizes and pointers live in separate arrays, so a child costs the sum of
+  // both fields rather than a padded pair. This matters once size_type is
+  // narrower than void_pointer.
   static constexpr std::size_t base_fit() {
-    return base_free() / sizeof(node_data);
+    return base_free() / (sizeof(void_pointer) + sizeof(size_type));
   }
 
-  static constexpr std::size_t segment_max() {
-    return segment_fit() > 1 ? segment_fit() : 1;
+  // Floating segments cost a second leaf_size_type per child for the offset.
+  static constexpr std::size_t leaf_fit() {
+    return leaf_free() /
+           (sizeof(void_pointer) +
+            sizeof(leaf_size_type) * (floating_segments() ? 2 : 1));
   }
 
   static constexpr std::size_t base_max() {
     return base_fit() > 3 ? base_fit() : 3;
   }
 
-  static constexpr std::size_t segment_min() { return (segment_max() + 1) / 2; }
+  static constexpr std::size_t leaf_max() {
+    return leaf_fit() > 3 ? leaf_fit() : 3;
+  }
+
+  // The erase code takes a leaf or index node of length 2 for the root unless
+  // the minimum is 2, so the minimum may not drop below it.
+  static constexpr std::size_t base_min() { return fill_min(base_max(), 2); }
+
+  static constexpr std::size_t leaf_min() { return fill_min(leaf_max(), 2); }
+
+  static constexpr std::size_t prefetch_distance() {
+    return BOOST_SEGMENTED_TREE_PREFETCH_DISTANCE;
+  }
+
+  static constexpr bool redistribute() {
+    return BOOST_SEGMENTED_TREE_REDISTRIBUTE != 0;
+  }
 
-  static constexpr std::size_t base_min() { return (base_max() + 1) / 2; }
+  static constexpr bool edge_split() {
+    return BOOST_SEGMENTED_TREE_EDGE_SPLIT != 0;
+  }
 
   // types
-  struct node {
-    node_pointer parent_pointer;
-    std::uint16_t parent_index_;
-    std::uint16_t length_;
-    std::array<size_type, base_max()> sizes;
-    std::array<void_pointer, base_max()> pointers;
+  struct node : node_base {
+    alignas(array_alignment<size_type>())
+        std::array<size_type, base_max()> sizes;
+    alignas(array_alignment<void_pointer>())
+        std::array<void_pointer, base_max()> pointers;
+  };
 
-    size_type parent_index() { return parent_index_; }
+  // How far the first element of each segment of a leaf is from the start of
+  // its block. Always 0 unless segments float.
+  template <bool Floating, typename = void>
+  struct leaf_offsets {
+    std::array<leaf_size_type, leaf_max()> offsets;
 
-    void parent_index(size_type index) {
-      parent_index_ = static_cast<std::uint16_t>(index);
+    size_type offset(size_type index) const { return offsets[index]; }
+
+    void offset(size_type index, size_type offset) {
+      offsets[index] = static_cast<leaf_size_type>(offset);
     }
+  };
 
-    size_type length() { return length_; }
+  template <typename Dummy>
+  struct leaf_offsets<false, Dummy> {
+    size_type offset(size_type) const { return 0; }
 
-    void length(size_type length) {
-      length_ = static_cast<std::uint16_t>(length);
-    }
+    void offset(size_type, size_type) {}
   };
 
+  struct leaf : leaf_base, leaf_offsets<floating_segments()> {
+    alignas(array_alignment<leaf_size_type>())
+        std::array<leaf_size_type, leaf_max()> sizes;
+    alignas(array_alignment<void_pointer>())
+        std::array<void_pointer, leaf_max()> pointers;
+  };
+
+  // What a segment records in front of its block when back_pointers() is set,
+  // as index nodes record their parent.
+  struct segment_parent {
+    leaf_pointer parent_pointer;
+    std::uint16_t parent_index;
+  };
+
+  // The number of elements whose room the record takes.
+  static constexpr std::size_t parent_length() {
+    return back_pointers()
+               ? (sizeof(segment_parent) + sizeof(T) - 1) / sizeof(T)
+               : 0;
+  }
+
+  // Iterators are passed by value, so indexes and lengths are stored in the
+  // narrowest type that holds them.
   struct segment_entry {
     element_pointer pointer;
-    size_type index;
-    size_type length;
+    leaf_size_type index_;
+    leaf_size_type length_;
+
+    size_type index() const { return index_; }
+
+    void index(size_type index) {
+      index_ = static_cast<leaf_size_type>(index);
+    }
+
+    size_type length() const { return length_; }
+
+    void length(size_type length) {
+      length_ = static_cast<leaf_size_type>(length);
+    }
   };
 
   struct leaf_entry {
-    node_pointer pointer;
-    size_type index;
+    leaf_pointer pointer;
+    std::uint16_t index_;
+
+    size_type index() const { return index_; }
+
+    void index(size_type index) { index_ = static_cast<std::uint16_t>(index); }
   };
 
   struct iterator_entry {
@@ -164,10 +506,18 @@ struct static_traits_t {
     return static_cast<element_pointer>(pointer);
   }
 
+  static base_pointer cast_base(void_pointer pointer) {
+    return static_cast<base_pointer>(pointer);
+  }
+
   static node_pointer cast_node(void_pointer pointer) {
     return static_cast<node_pointer>(pointer);
   }
 
+  static leaf_pointer cast_leaf(void_pointer pointer) {
+    return static_cast<leaf_pointer>(pointer);
+  }
+
   // find_index
   static iterator_data find_index_root(void_pointer pointer, size_type sz,
                                        size_type ht, size_type pos) {
@@ -176,18 +526,18 @@ struct static_traits_t {
 
     if (ht < 2) {
       it.entry.leaf.pointer = nullptr;
-      it.entry.leaf.index = 0;
+      it.entry.leaf.index(0);
       it.entry.segment = find_index_segment(cast_segment(pointer), sz, pos);
     } else
-      it.entry = find_index_node(cast_node(pointer), ht, pos);
+      it.entry = find_index_node(pointer, ht, pos);
 
     return it;
   }
 
-  static iterator_entry find_index_node(node_pointer pointer, size_type ht,
+  static iterator_entry find_index_node(void_pointer pointer, size_type ht,
                                         size_type pos) {
-    if (ht == 2) return find_index_leaf(pointer, pos);
-    return find_index_branch(pointer, ht, pos);
+    if (ht == 2) return find_index_leaf(cast_leaf(pointer), pos);
+    return find_index_branch(cast_node(pointer), ht, pos);
   }
 
   static iterator_entry find_index_branch(node_pointer pointer, size_type ht,
@@ -202,14 +552,15 @@ struct static_traits_t {
       }
 
       auto child = cast_node(pointer->pointers[index]);
+      detail::prefetch(child);
       --ht;
-      if (ht == 2) return find_index_leaf(child, pos);
+      if (ht == 2) return find_index_leaf(cast_leaf(child), pos);
 
       pointer = child;
     }
   }
 
-  static iterator_entry find_index_leaf(node_pointer pointer, size_type pos) {
+  static iterator_entry find_index_leaf(leaf_pointer pointer, size_type pos) {
     size_type index = 0;
     auto size = pointer->sizes[0];
     while (pos >= size) {
@@ -218,11 +569,13 @@ struct static_traits_t {
       size = pointer->sizes[index];
     }
 
+    auto segment = cast_segment(pointer->pointers[index]);
+    detail::prefetch(segment + pos);
+
     iterator_entry entry;
     entry.leaf.pointer = pointer;
-    entry.leaf.index = index;
-    entry.segment = find_index_segment(cast_segment(pointer->pointers[index]),
-                                       pointer->sizes[index], pos);
+    entry.leaf.index(index);
+    entry.segment = find_index_segment(segment, pointer->sizes[index], pos);
     return entry;
   }
 
@@ -230,8 +583,8 @@ struct static_traits_t {
                                           size_type pos) {
     segment_entry entry;
     entry.pointer = pointer;
-    entry.index = pos;
-    entry.length = sz;
+    entry.index(pos);
+    entry.length(sz);
     return entry;
   }
 
@@ -243,33 +596,33 @@ struct static_traits_t {
 
     if (ht < 2) {
       it.entry.leaf.pointer = nullptr;
-      it.entry.leaf.index = 0;
+      it.entry.leaf.index(0);
       it.entry.segment = find_first_segment(cast_segment(pointer), sz);
     } else
-      it.entry = find_first_node(cast_node(pointer), ht);
+      it.entry = find_first_node(pointer, ht);
 
     return it;
   }
 
-  static iterator_entry find_first_node(node_pointer pointer, size_type ht) {
-    if (ht == 2) return find_first_leaf(pointer);
-    return find_first_branch(pointer, ht);
+  static iterator_entry find_first_node(void_pointer pointer, size_type ht) {
+    if (ht == 2) return find_first_leaf(cast_leaf(pointer));
+    return find_first_branch(cast_node(pointer), ht);
   }
 
   static iterator_entry find_first_branch(node_pointer pointer, size_type ht) {
     while (true) {
       auto child = cast_node(pointer->pointers[0]);
       --ht;
-      if (ht == 2) return find_first_leaf(child);
+      if (ht == 2) return find_first_leaf(cast_leaf(child));
 
       pointer = child;
     }
   }
 
-  static iterator_entry find_first_leaf(node_pointer pointer) {
+  static iterator_entry find_first_leaf(leaf_pointer pointer) {
     iterator_entry entry;
     entry.leaf.pointer = pointer;
-    entry.leaf.index = 0;
+    entry.leaf.index(0);
     entry.segment = find_first_segment(cast_segment(pointer->pointers[0]),
                                        pointer->sizes[0]);
     return entry;
@@ -279,8 +632,8 @@ struct static_traits_t {
                                           size_type sz) {
     segment_entry entry;
     entry.pointer = pointer;
-    entry.index = 0;
-    entry.length = sz;
+    entry.index(0);
+    entry.length(sz);
     return entry;
   }
 
@@ -292,17 +645,17 @@ struct static_traits_t {
 
     if (ht < 2) {
       it.entry.leaf.pointer = nullptr;
-      it.entry.leaf.index = 0;
+      it.entry.leaf.index(0);
       it.entry.segment = find_last_segment(cast_segment(pointer), sz);
     } else
-      it.entry = find_last_node(cast_node(pointer), ht);
+      it.entry = find_last_node(pointer, ht);
 
     return it;
   }
 
-  static iterator_entry find_last_node(node_pointer pointer, size_type ht) {
-    if (ht == 2) return find_last_leaf(pointer);
-    return find_last_branch(pointer, ht);
+  static iterator_entry find_last_node(void_pointer pointer, size_type ht) {
+    if (ht == 2) return find_last_leaf(cast_leaf(pointer));
+    return find_last_branch(cast_node(pointer), ht);
   }
 
   static iterator_entry find_last_branch(node_pointer pointer, size_type ht) {
@@ -310,19 +663,19 @@ struct static_traits_t {
       auto index = pointer->length() - 1;
       auto child = cast_node(pointer->pointers[index]);
       --ht;
-      if (ht == 2) return find_last_leaf(child);
+      if (ht == 2) return find_last_leaf(cast_leaf(child));
 
       pointer = child;
     }
   }
 
-  static iterator_entry find_last_leaf(node_pointer pointer) {
+  static iterator_entry find_last_leaf(leaf_pointer pointer) {
     iterator_entry entry;
     entry.leaf.pointer = pointer;
-    entry.leaf.index = pointer->length() - 1;
+    entry.leaf.index(pointer->length() - 1);
     entry.segment =
-        find_last_segment(cast_segment(pointer->pointers[entry.leaf.index]),
-                          pointer->sizes[entry.leaf.index]);
+        find_last_segment(cast_segment(pointer->pointers[entry.leaf.index()]),
+                          pointer->sizes[entry.leaf.index()]);
     return entry;
   }
 
@@ -330,8 +683,8 @@ struct static_traits_t {
                                          size_type sz) {
     segment_entry entry;
     entry.pointer = pointer;
-    entry.index = sz - 1;
-    entry.length = sz;
+    entry.index(sz - 1);
+    entry.length(sz);
     return entry;
   }
 
@@ -343,17 +696,17 @@ struct static_traits_t {
 
     if (ht < 2) {
       it.entry.leaf.pointer = nullptr;
-      it.entry.leaf.index = 0;
+      it.entry.leaf.index(0);
       it.entry.segment = find_end_segment(cast_segment(pointer), sz);
     } else
-      it.entry = find_end_node(cast_node(pointer), ht);
+      it.entry = find_end_node(pointer, ht);
 
     return it;
   }
 
-  static iterator_entry find_end_node(node_pointer pointer, size_type ht) {
-    if (ht == 2) return find_end_leaf(pointer);
-    return find_end_branch(pointer, ht);
+  static iterator_entry find_end_node(void_pointer pointer, size_type ht) {
+    if (ht == 2) return find_end_leaf(cast_leaf(pointer));
+    return find_end_branch(cast_node(pointer), ht);
   }
 
   static iterator_entry find_end_branch(node_pointer pointer, size_type ht) {
@@ -362,17 +715,17 @@ struct static_traits_t {
       auto child = cast_node(pointer->pointers[index]);
 
       --ht;
-      if (ht == 2) return find_end_leaf(child);
+      if (ht == 2) return find_end_leaf(cast_leaf(child));
 
       pointer = child;
     }
   }
 
-  static iterator_entry find_end_leaf(node_pointer pointer) {
+  static iterator_entry find_end_leaf(leaf_pointer pointer) {
     iterator_entry entry;
     auto index = pointer->length() - 1;
     entry.leaf.pointer = pointer;
-    entry.leaf.index = index;
+    entry.leaf.index(index);
     entry.segment = find_end_segment(cast_segment(pointer->pointers[index]),
                                      pointer->sizes[index]);
     return entry;
@@ -381,11 +734,42 @@ struct static_traits_t {
   static segment_entry find_end_segment(element_pointer pointer, size_type sz) {
     segment_entry entry;
     entry.pointer = pointer;
-    entry.index = sz;
-    entry.length = sz;
+    entry.index(sz);
+    entry.length(sz);
     return entry;
   }
 
+  // prefetch
+  static void prefetch_next_leaf(leaf_pointer pointer, size_type index) {
+    if (prefetch_distance() == 0) return;
+
+    auto ahead = index + prefetch_distance();
+    if (ahead < pointer->length()) {
+      detail::prefetch(cast_segment(pointer->pointers[ahead]));
+      return;
+    }
+
+    // Once the window runs past the leaf, fetch the next leaf instead.
+    auto next_pointer = pointer->next_pointer;
+    if (ahead == pointer->length() && next_pointer != nullptr)
+      detail::prefetch(next_pointer);
+  }
+
+  static void prefetch_prev_leaf(leaf_pointer pointer, size_type index) {
+    if (prefetch_distance() == 0) return;
+
+    if (index >= prefetch_distance()) {
+      detail::prefetch(
+          cast_segment(pointer->pointers[index - prefetch_distance()]));
+      return;
+    }
+
+    // Once the window runs past the leaf, fetch the previous leaf instead.
+    auto prev_pointer = pointer->prev_pointer;
+    if (index + 1 == prefetch_distance() && prev_pointer != nullptr)
+      detail::prefetch(prev_pointer);
+  }
+
   // move_next
   static void move_next_iterator(iterator_data& it) {
     ++it.pos;
@@ -393,12 +777,12 @@ struct static_traits_t {
   }
 
   static void move_next_segment(iterator_entry& entry) {
-    auto index = entry.segment.index;
-    auto length = entry.segment.length;
+    auto index = entry.segment.index();
+    auto length = entry.segment.length();
 
     ++index;
     if (index != length) {
-      entry.segment.index = index;
+      entry.segment.index(index);
       return;
     }
 
@@ -407,46 +791,33 @@ struct static_traits_t {
 
   static void move_next_leaf(iterator_entry& entry) {
     auto pointer = entry.leaf.pointer;
-    auto index = entry.leaf.index;
+    auto index = entry.leaf.index();
 
     // Special case for end iterator.
     if (pointer == nullptr) {
-      entry.segment.index = entry.segment.length;
+      entry.segment.index(entry.segment.length());
       return;
     }
 
     ++index;
     if (index != pointer->length()) {
-      entry.leaf.index = index;
+      entry.leaf.index(index);
       entry.segment = find_first_segment(cast_segment(pointer->pointers[index]),
                                          pointer->sizes[index]);
+      prefetch_next_leaf(pointer, index);
       return;
     }
 
-    move_next_branch(entry, pointer->parent_pointer, pointer->parent_index());
-  }
-
-  static void move_next_branch(iterator_entry& entry, node_pointer pointer,
-                               size_type index) {
-    size_type child_ht = 2;
-
-    while (true) {
-      // Special case for end iterator.
-      if (pointer == nullptr) {
-        entry.segment.index = entry.segment.length;
-        return;
-      }
-
-      ++index;
-      if (index != pointer->length()) {
-        entry = find_first_node(cast_node(pointer->pointers[index]), child_ht);
-        return;
-      }
+    pointer = pointer->next_pointer;
 
-      index = pointer->parent_index();
-      pointer = pointer->parent_pointer;
-      ++child_ht;
+    // Special case for end iterator.
+    if (pointer == nullptr) {
+      entry.segment.index(entry.segment.length());
+      return;
     }
+
+    entry = find_first_leaf(pointer);
+    prefetch_next_leaf(pointer, 0);
   }
 
   // move_prev
@@ -456,11 +827,11 @@ struct static_traits_t {
   }
 
   static void move_prev_segment(iterator_entry& entry) {
-    auto index = entry.segment.index;
+    auto index = entry.segment.index();
 
     if (index != 0) {
       --index;
-      entry.segment.index = index;
+      entry.segment.index(index);
       return;
     }
 
@@ -469,34 +840,20 @@ struct static_traits_t {
 
   static void move_prev_leaf(iterator_entry& entry) {
     auto pointer = entry.leaf.pointer;
-    auto index = entry.leaf.index;
+    auto index = entry.leaf.index();
 
     if (index != 0) {
       --index;
-      entry.leaf.index = index;
+      entry.leaf.index(index);
       entry.segment = find_last_segment(cast_segment(pointer->pointers[index]),
                                         pointer->sizes[index]);
+      prefetch_prev_leaf(pointer, index);
       return;
     }
 
-    move_prev_branch(entry, pointer->parent_pointer, pointer->parent_index());
-  }
-
-  static void move_prev_branch(iterator_entry& entry, node_pointer pointer,
-                               size_type index) {
-    size_type child_ht = 2;
-
-    while (true) {
-      if (index != 0) {
-        entry =
-            find_last_node(cast_node(pointer->pointers[index - 1]), child_ht);
-        return;
-      }
-
-      index = pointer->parent_index();
-      pointer = pointer->parent_pointer;
-      ++child_ht;
-    }
+    pointer = pointer->prev_pointer;
+    entry = find_last_leaf(pointer);
+    prefetch_prev_leaf(pointer, entry.leaf.index());
   }
 
   // move_count
@@ -516,12 +873,12 @@ struct static_traits_t {
   }
 
   static void move_next_segment_count(iterator_entry& entry, size_type count) {
-    auto index = entry.segment.index;
-    auto length = entry.segment.length;
+    auto index = entry.segment.index();
+    auto length = entry.segment.length();
 
     index += count;
     if (index < length) {
-      entry.segment.index = index;
+      entry.segment.index(index);
       return;
     }
 
@@ -530,11 +887,11 @@ struct static_traits_t {
 
   static void move_next_leaf_count(iterator_entry& entry, size_type count) {
     auto pointer = entry.leaf.pointer;
-    auto index = entry.leaf.index;
+    auto index = entry.leaf.index();
 
     // Special case for end iterator.
     if (pointer == nullptr) {
-      entry.segment.index = entry.segment.length;
+      entry.segment.index(entry.segment.length());
       return;
     }
 
@@ -544,7 +901,7 @@ struct static_traits_t {
 
       auto size = pointer->sizes[index];
       if (size > count) {
-        entry.leaf.index = index;
+        entry.leaf.index(index);
         entry.segment = find_index_segment(
             cast_segment(pointer->pointers[index]), size, count);
         return;
@@ -552,11 +909,32 @@ struct static_traits_t {
       count -= size;
     }
 
-    move_next_branch_count(entry, pointer, pointer->parent_pointer,
-                           pointer->parent_index(), count);
+    // Try the next leaf before climbing, so short hops stay on the leaf level.
+    auto next_pointer = pointer->next_pointer;
+
+    // Special case for end iterator.
+    if (next_pointer == nullptr) {
+      entry = find_end_leaf(pointer);
+      return;
+    }
+
+    for (index = 0; index != next_pointer->length(); ++index) {
+      auto size = next_pointer->sizes[index];
+      if (size > count) {
+        entry.leaf.pointer = next_pointer;
+        entry.leaf.index(index);
+        entry.segment = find_index_segment(
+            cast_segment(next_pointer->pointers[index]), size, count);
+        return;
+      }
+      count -= size;
+    }
+
+    move_next_branch_count(entry, next_pointer, next_pointer->parent_pointer,
+                           next_pointer->parent_index(), count);
   }
 
-  static void move_next_branch_count(iterator_entry& entry, node_pointer base,
+  static void move_next_branch_count(iterator_entry& entry, void_pointer base,
                                      node_pointer pointer, size_type index,
                                      size_type count) {
     size_type child_ht = 2;
@@ -574,8 +952,7 @@ struct static_traits_t {
 
         auto size = pointer->sizes[index];
         if (size > count) {
-          entry = find_index_node(cast_node(pointer->pointers[index]), child_ht,
-                                  count);
+          entry = find_index_node(pointer->pointers[index], child_ht, count);
           return;
         }
         count -= size;
@@ -595,11 +972,11 @@ struct static_traits_t {
   }
 
   static void move_prev_segment_count(iterator_entry& entry, size_type count) {
-    auto index = entry.segment.index;
+    auto index = entry.segment.index();
 
     if (index >= count) {
       index -= count;
-      entry.segment.index = index;
+      entry.segment.index(index);
       return;
     }
 
@@ -608,7 +985,7 @@ struct static_traits_t {
 
   static void move_prev_leaf_count(iterator_entry& entry, size_type count) {
     auto pointer = entry.leaf.pointer;
-    auto index = entry.leaf.index;
+    auto index = entry.leaf.index();
 
     while (true) {
       if (index == 0) break;
@@ -616,7 +993,7 @@ struct static_traits_t {
 
       auto size = pointer->sizes[index];
       if (size >= count) {
-        entry.leaf.index = index;
+        entry.leaf.index(index);
         entry.segment = find_index_segment(
             cast_segment(pointer->pointers[index]), size, size - count);
         return;
@@ -624,8 +1001,27 @@ struct static_traits_t {
       count -= size;
     }
 
-    move_prev_branch_count(entry, pointer->parent_pointer,
-                           pointer->parent_index(), count);
+    // Try the previous leaf before climbing, so short hops stay on the leaf
+    // level.
+    auto prev_pointer = pointer->prev_pointer;
+    index = prev_pointer->length();
+
+    while (index != 0) {
+      --index;
+
+      auto size = prev_pointer->sizes[index];
+      if (size >= count) {
+        entry.leaf.pointer = prev_pointer;
+        entry.leaf.index(index);
+        entry.segment = find_index_segment(
+            cast_segment(prev_pointer->pointers[index]), size, size - count);
+        return;
+      }
+      count -= size;
+    }
+
+    move_prev_branch_count(entry, prev_pointer->parent_pointer,
+                           prev_pointer->parent_index(), count);
   }
 
   static void move_prev_branch_count(iterator_entry& entry,
@@ -640,7 +1036,7 @@ struct static_traits_t {
 
         auto size = pointer->sizes[index];
         if (size >= count) {
-          entry = find_index_node(cast_node(pointer->pointers[index]), child_ht,
+          entry = find_index_node(pointer->pointers[index], child_ht,
                                   size - count);
           return;
         }
@@ -658,20 +1054,20 @@ struct static_traits_t {
   }
 
   static element_pointer current_element(iterator_data it) {
-    return it.entry.segment.pointer + it.entry.segment.index;
+    return it.entry.segment.pointer + it.entry.segment.index();
   }
 
   static element_pointer last_element(iterator_data it) {
-    return it.entry.segment.pointer + it.entry.segment.length;
+    return it.entry.segment.pointer + it.entry.segment.length();
   }
 
   static value_type& dereference(iterator_data it) {
-    return it.entry.segment.pointer[it.entry.segment.index];
+    return it.entry.segment.pointer[it.entry.segment.index()];
   }
 
   static value_type& dereference_count(iterator_data it, difference_type diff) {
     move_iterator_count(it, diff);
-    return it.entry.segment.pointer[it.entry.segment.index];
+    return it.entry.segment.pointer[it.entry.segment.index()];
   }
 
   static difference_type difference(iterator_data a, iterator_data b) {
@@ -680,22 +1076,22 @@ struct static_traits_t {
   }
 
   static void move_after_segment(iterator_data& it) {
-    it.pos += it.entry.segment.length - it.entry.segment.index;
+    it.pos += it.entry.segment.length() - it.entry.segment.index();
     move_next_leaf(it.entry);
   }
 
   static void move_after_segment_count(iterator_data& it, size_type count) {
-    it.pos += it.entry.segment.length - it.entry.segment.index + count;
+    it.pos += it.entry.segment.length() - it.entry.segment.index() + count;
     move_next_leaf_count(it.entry, count);
   }
 
   static void move_before_segment(iterator_data& it) {
-    it.pos -= it.entry.segment.index + 1;
+    it.pos -= it.entry.segment.index() + 1;
     move_prev_leaf(it.entry);
   }
 
   static void move_before_segment_count(iterator_data& it, size_type count) {
-    it.pos -= it.entry.segment.index + 1 - count;
+    it.pos -= it.entry.segment.index() + 1 - count;
     move_prev_leaf_count(it.entry, count);
   }
 };
@@ -1118,10 +1514,14 @@ class iterator_t {
 ///
 /// \tparam T The type of the element to be stored
 /// \tparam Allocator The type of the allocator used for all memory management
-/// \tparam segment_target The size in bytes to try to use for element nodes
-/// \tparam base_target The size in bytes to try to use for index nodes
+/// \tparam segment_target The size in bytes to try to use for element nodes,
+/// which hold at least BOOST_SEGMENTED_TREE_MIN_SEGMENT_LENGTH elements
+/// \tparam base_target The size in bytes to try to use for index nodes above
+/// the leaves
+/// \tparam leaf_target The size in bytes to try to use for leaf nodes, which
+/// hold the segments
 template <typename T, typename Allocator, std::size_t segment_target,
-          std::size_t base_target>
+          std::size_t base_target, std::size_t leaf_target>
 class seq {
  private:
   // alias
@@ -1129,11 +1529,14 @@ class seq {
   using static_traits =
       detail::static_traits_t<T, typename element_traits::void_pointer,
                               typename element_traits::size_type,
-                              segment_target, base_target>;
+                              segment_target, base_target, leaf_target,
+                              detail::allocator_alignment<Allocator>::value>;
   using element_pointer = typename static_traits::element_pointer;
   using void_pointer = typename static_traits::void_pointer;
   using node_pointer = typename static_traits::node_pointer;
+  using leaf_pointer = typename static_traits::leaf_pointer;
   using node_type = typename static_traits::node;
+  using leaf_type = typename static_traits::leaf;
   using iterator_data = typename static_traits::iterator_data;
   using iterator_entry = typename static_traits::iterator_entry;
   using leaf_entry = typename static_traits::leaf_entry;
@@ -1141,6 +1544,10 @@ class seq {
       typename element_traits::template rebind_alloc<node_type>;
   using node_traits =
       typename element_traits::template rebind_traits<node_type>;
+  using leaf_allocator =
+      typename element_traits::template rebind_alloc<leaf_type>;
+  using leaf_traits =
+      typename element_traits::template rebind_traits<leaf_type>;
 
  public:
   /// The type of elements stored in the container.
@@ -1174,6 +1581,11 @@ class seq {
 #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
   // private data
   void_pointer root_{nullptr};
+  // The capacity of the root block while the tree is a single segment.
+  typename static_traits::leaf_size_type root_capacity_{0};
+  // The capacity of every other segment, see segment_limit().
+  typename static_traits::leaf_size_type segment_max_{
+      static_traits::segment_max()};
 
   struct size_pair : allocator_type {
     size_type sz;
@@ -1181,12 +1593,30 @@ class seq {
     size_pair(allocator_type const& alloc) : allocator_type{alloc}, sz{} {}
   } size_pair_{};
 
-  struct height_pair : node_allocator {
+  using segment_index = detail::segment_index<static_traits::back_pointers()>;
+
+  // The segment index takes no room unless back pointers are enabled.
+  struct height_pair : node_allocator, segment_index {
     size_type ht;
     height_pair() = default;
-    height_pair(allocator_type const& alloc) : node_allocator{alloc}, ht{} {}
+    height_pair(allocator_type const& alloc)
+        : node_allocator{alloc}, segment_index{}, ht{} {}
   } height_pair_{};
 
+  // Freed blocks kept for reuse, each list threaded through its blocks. While
+  // capacity is not 0 no block is returned to the allocator, so the blocks
+  // reserve() provided for capacity elements stay available.
+  struct block_cache {
+    void_pointer segments{nullptr};
+    void_pointer leaves{nullptr};
+    void_pointer nodes{nullptr};
+    size_type segment_count{0};
+    size_type leaf_count{0};
+    size_type node_count{0};
+    size_type capacity{0};
+    std::uint16_t limit{BOOST_SEGMENTED_TREE_CACHE_LIMIT};
+  } cache_{};
+
   // getters
   void_pointer& get_root() { return root_; }
   void_pointer const& get_root() const { return root_; }
@@ -1198,59 +1628,709 @@ class seq {
   allocator_type const& get_element_allocator() const { return size_pair_; }
   node_allocator& get_node_allocator() { return height_pair_; }
   node_allocator const& get_node_allocator() const { return height_pair_; }
+  segment_index& get_segment_index() { return height_pair_; }
+  segment_index const& get_segment_index() const { return height_pair_; }
 
-  // allocate
-  element_pointer allocate_segment() {
-    return element_traits::allocate(get_element_allocator(),
-                                    static_traits::segment_max());
+  // geometry
+  size_type segment_max() const {
+    return static_traits::runtime_geometry() ? segment_max_
+                                             : static_traits::segment_max();
   }
 
-  node_pointer allocate_node() {
-    return node_traits::allocate(get_node_allocator(), 1);
+  size_type segment_min() const {
+    return static_traits::runtime_geometry()
+               ? static_traits::fill_min(segment_max_, 1)
+               : static_traits::segment_min();
   }
 
-  // destroy
-  void destroy_segment(element_pointer pointer, size_type index) {
-    element_traits::destroy(get_element_allocator(),
-                            std::addressof(pointer[index]));
+  // cache
+  // A trivially copyable link is copied bytewise and needs no alignment.
+  static constexpr bool copy_links() {
+    return std::is_trivially_copyable<void_pointer>::value;
   }
 
-  void destroy_node(node_pointer pointer, size_type index) {
-    pointer->pointers[index].~void_pointer();
+  // A segment can only hold the list link if it is large and aligned enough.
+  bool cache_segments() const {
+    return sizeof(T) * segment_max() >= sizeof(void_pointer) &&
+           (copy_links() || alignof(T) >= alignof(void_pointer));
   }
 
-  // deallocate
-  void deallocate_segment(element_pointer pointer) {
-    element_traits::deallocate(get_element_allocator(), pointer,
-                               static_traits::segment_max());
+  static void store_link(void* address, void_pointer link, std::true_type) {
+    std::memcpy(address, std::addressof(link), sizeof(void_pointer));
   }
 
-  void deallocate_node(node_pointer pointer) {
-    node_traits::deallocate(get_node_allocator(), pointer, 1);
+  static void store_link(void* address, void_pointer link, std::false_type) {
+    ::new (address) void_pointer(link);
   }
 
-  // purge
-  void purge() { purge_root(get_root(), get_size(), get_height()); }
+  static void_pointer load_link(void* address, std::true_type) {
+    void_pointer link;
+    std::memcpy(std::addressof(link), address, sizeof(void_pointer));
+    return link;
+  }
 
-  void purge_segment(element_pointer, size_type, std::true_type) {}
+  static void_pointer load_link(void* address, std::false_type) {
+    auto next = static_cast<void_pointer*>(address);
+    auto link = *next;
+    next->~void_pointer();
+    return link;
+  }
 
-  void purge_segment(element_pointer pointer, size_type sz, std::false_type) {
-    for (size_type i = 0, e = sz; i != e; ++i) destroy_segment(pointer, i);
+  template <typename Pointer>
+  static void push_cache(void_pointer& head, size_type& count,
+                         Pointer pointer) {
+    auto address = static_cast<void*>(std::addressof(*pointer));
+    store_link(address, head,
+               std::integral_constant<bool, copy_links()>{});
+    head = pointer;
+    ++count;
   }
 
-  void purge_segment(element_pointer pointer, size_type sz) {
-    purge_segment(
-        pointer, sz,
-        std::integral_constant<bool,
-                               std::is_trivially_destructible<T>::value>{});
-    deallocate_segment(pointer);
+  template <typename Pointer>
+  static Pointer pop_cache(void_pointer& head, size_type& count) {
+    auto pointer = static_cast<Pointer>(head);
+    auto address = static_cast<void*>(std::addressof(*pointer));
+    head = load_link(address, std::integral_constant<bool, copy_links()>{});
+    --count;
+    return pointer;
   }
 
-  void purge_node(node_pointer pointer, size_type ht) {
-    if (ht == 2) {
+  // The cached blocks follow the allocator that owns them, the limits stay.
+  void swap_cache(seq& other) noexcept {
+    using std::swap;
+    swap(cache_.segments, other.cache_.segments);
+    swap(cache_.leaves, other.cache_.leaves);
+    swap(cache_.nodes, other.cache_.nodes);
+    swap(cache_.segment_count, other.cache_.segment_count);
+    swap(cache_.leaf_count, other.cache_.leaf_count);
+    swap(cache_.node_count, other.cache_.node_count);
+    swap(cache_.capacity, other.cache_.capacity);
+  }
+
+  // Returns every cached block to the allocator and drops any reservation.
+  void release_cache() {
+    cache_.capacity = 0;
+    trim_cache(0);
+  }
+
+  void trim_cache(size_type limit) {
+    while (cache_.segment_count > limit)
+      deallocate_block(
+          pop_cache<element_pointer>(cache_.segments, cache_.segment_count),
+          segment_max());
+
+    leaf_allocator alloc{get_node_allocator()};
+    while (cache_.leaf_count > limit)
+      leaf_traits::deallocate(
+          alloc, pop_cache<leaf_pointer>(cache_.leaves, cache_.leaf_count), 1);
+
+    while (cache_.node_count > limit)
+      node_traits::deallocate(
+          get_node_allocator(),
+          pop_cache<node_pointer>(cache_.nodes, cache_.node_count), 1);
+  }
+
+  // block
+  // The blocks of segments start parent_length() elements into their
+  // allocation, after the room for the segment's parent.
+  element_pointer allocate_block(
+      size_type capacity,
+      typename element_traits::const_void_pointer hint = nullptr) {
+    auto length = static_cast<difference_type>(static_traits::parent_length());
+    return element_traits::allocate(get_element_allocator(),
+                                    capacity + static_traits::parent_length(),
+                                    hint) +
+           length;
+  }
+
+  void deallocate_block(element_pointer pointer, size_type capacity) {
+    auto length = static_cast<difference_type>(static_traits::parent_length());
+    element_traits::deallocate(get_element_allocator(), pointer - length,
+                               capacity + static_traits::parent_length());
+  }
+
+  // Adds a block taken for a segment of the tree to the segment index, or
+  // frees it if that fails.
+  element_pointer index_block(element_pointer pointer, size_type capacity) {
+    if (!static_traits::back_pointers()) return pointer;
+    try {
+      get_segment_index().insert(std::addressof(pointer[0]),
+                                 capacity * sizeof(T));
+    } catch (...) {
+      deallocate_block(pointer, capacity);
+      throw;
+    }
+    return pointer;
+  }
+
+  // allocate
+  // A hint is the start of a block of the same kind that the new one will sit
+  // next to in the tree, for allocators that place blocks near each other.
+  element_pointer allocate_segment(
+      typename element_traits::const_void_pointer hint = nullptr) {
+    if (cache_segments() && cache_.segment_count != 0)
+      return index_block(
+          pop_cache<element_pointer>(cache_.segments, cache_.segment_count),
+          segment_max());
+    return index_block(allocate_block(segment_max(), hint), segment_max());
+  }
+
+  node_pointer allocate_node() {
+    if (cache_.node_count != 0)
+      return pop_cache<node_pointer>(cache_.nodes, cache_.node_count);
+    return node_traits::allocate(get_node_allocator(), 1);
+  }
+
+  leaf_pointer allocate_leaf(
+      typename leaf_traits::const_void_pointer hint = nullptr) {
+    if (cache_.leaf_count != 0)
+      return pop_cache<leaf_pointer>(cache_.leaves, cache_.leaf_count);
+    leaf_allocator alloc{get_node_allocator()};
+    return leaf_traits::allocate(alloc, 1, hint);
+  }
+
+  // destroy
+  void destroy_segment(element_pointer pointer, size_type index) {
+    element_traits::destroy(get_element_allocator(),
+                            std::addressof(pointer[index]));
+  }
+
+  void destroy_node(node_pointer pointer, size_type index) {
+    pointer->pointers[index].~void_pointer();
+  }
+
+  void destroy_leaf(leaf_pointer pointer, size_type index) {
+    pointer->pointers[index].~void_pointer();
+  }
+
+  // deallocate
+  void deallocate_segment(element_pointer pointer) {
+    get_segment_index().erase(std::addressof(pointer[0]));
+    if (cache_segments() && (cache_.segment_count < cache_.limit ||
+                             cache_.capacity != 0)) {
+      push_cache(cache_.segments, cache_.segment_count, pointer);
+      return;
+    }
+    deallocate_block(pointer, segment_max());
+  }
+
+  void deallocate_node(node_pointer pointer) {
+    if (cache_.node_count < cache_.limit || cache_.capacity != 0) {
+      push_cache(cache_.nodes, cache_.node_count, pointer);
+      return;
+    }
+    node_traits::deallocate(get_node_allocator(), pointer, 1);
+  }
+
+  void deallocate_leaf(leaf_pointer pointer) {
+    if (cache_.leaf_count < cache_.limit || cache_.capacity != 0) {
+      push_cache(cache_.leaves, cache_.leaf_count, pointer);
+      return;
+    }
+    leaf_allocator alloc{get_node_allocator()};
+    leaf_traits::deallocate(alloc, pointer, 1);
+  }
+
+  // root
+  // The root segment of a new tree holds root_min() elements and doubles its
+  // capacity whenever it overflows, until it is a full segment. Returns the
+  // least capacity on the way that holds count elements.
+  size_type root_fit(size_type count) const {
+    size_type capacity = (std::min)(size_type{static_traits::root_min()},
+                                    segment_max());
+    while (capacity < count)
+      capacity = capacity > segment_max() / 2
+                     ? segment_max()
+                     : capacity * 2;
+    return capacity;
+  }
+
+  // A full segment left in the cache costs nothing to take.
+  size_type root_grow(size_type count) const {
+    if (cache_segments() && cache_.segment_count != 0)
+      return segment_max();
+    return root_fit(count);
+  }
+
+  element_pointer allocate_root(size_type capacity) {
+    if (capacity == segment_max()) return allocate_segment();
+    return index_block(allocate_block(capacity), capacity);
+  }
+
+  void deallocate_root(element_pointer pointer, size_type capacity) {
+    if (capacity == segment_max()) {
+      deallocate_segment(pointer);
+    } else {
+      get_segment_index().erase(std::addressof(pointer[0]));
+      deallocate_block(pointer, capacity);
+    }
+  }
+
+  void relocate_root(element_pointer source, element_pointer dest,
+                     size_type count, std::true_type) {
+    std::memcpy(static_cast<void*>(std::addressof(dest[0])),
+                std::addressof(source[0]), count * sizeof(T));
+  }
+
+  // Elements whose move may throw are copied, so the old root stays intact
+  // until all of them are in place.
+  void relocate_root(element_pointer source, element_pointer dest,
+                     size_type count, std::false_type) {
+    size_type index = 0;
+    try {
+      for (; index != count; ++index)
+        element_traits::construct(get_element_allocator(),
+                                  std::addressof(dest[index]),
+                                  std::move_if_noexcept(source[index]));
+    } catch (...) {
+      while (index != 0) destroy_segment(dest, --index);
+      throw;
+    }
+    for (index = 0; index != count; ++index) destroy_segment(source, index);
+  }
+
+  // Moves the root segment into a block of capacity elements.
+  void reallocate_root(size_type capacity) {
+    auto pointer = static_traits::cast_segment(get_root());
+    auto alloc = allocate_root(capacity);
+    try {
+      relocate_root(pointer, alloc, get_size(), relocate_bitwise{});
+    } catch (...) {
+      deallocate_root(alloc, capacity);
+      throw;
+    }
+    deallocate_root(pointer, root_capacity_);
+    get_root() = alloc;
+    root_capacity_ =
+        static_cast<typename static_traits::leaf_size_type>(capacity);
+  }
+
+  // reserve
+  void count_blocks(void_pointer pointer, size_type height, size_type& segments,
+                    size_type& leaves, size_type& nodes) const {
+    // A root smaller than a segment needs a full one to grow into.
+    if (height == 1) {
+      if (root_capacity_ == segment_max()) ++segments;
+      return;
+    }
+
+    if (height == 2) {
+      ++leaves;
+      segments += static_traits::cast_leaf(pointer)->length();
+      return;
+    }
+
+    ++nodes;
+    auto node = static_traits::cast_node(pointer);
+    for (size_type i = 0; i != node->length(); ++i)
+      count_blocks(node->pointers[i], height - 1, segments, leaves, nodes);
+  }
+
+  // Fills the cache until the blocks in use and cached cover the largest tree
+  // of count elements, where every block below the root is at its minimum.
+  void reserve_blocks(size_type count) {
+    size_type segments = 0;
+    size_type leaves = 0;
+    size_type nodes = 0;
+    if (get_height() != 0)
+      count_blocks(get_root(), get_height(), segments, leaves, nodes);
+
+    auto segments_max = (std::max)(
+        size_type{1}, count / size_type{segment_min()});
+    auto leaves_max = (std::max)(
+        size_type{1}, segments_max / size_type{static_traits::leaf_min()});
+    size_type nodes_max = 0;
+    for (auto level = leaves_max; level != 1;) {
+      level = (std::max)(size_type{1},
+                         level / size_type{static_traits::base_min()});
+      nodes_max += level;
+    }
+
+    fill_cache(segments_max - (std::min)(segments, segments_max),
+               leaves_max - (std::min)(leaves, leaves_max),
+               nodes_max - (std::min)(nodes, nodes_max));
+  }
+
+  // Allocates blocks until the cache holds at least the given counts.
+  void fill_cache(size_type segments, size_type leaves, size_type nodes) {
+    if (cache_segments()) {
+      while (cache_.segment_count < segments)
+        push_cache(cache_.segments, cache_.segment_count,
+                   allocate_block(segment_max()));
+    }
+
+    leaf_allocator alloc{get_node_allocator()};
+    while (cache_.leaf_count < leaves)
+      push_cache(cache_.leaves, cache_.leaf_count,
+                 leaf_traits::allocate(alloc, 1));
+
+    while (cache_.node_count < nodes)
+      push_cache(cache_.nodes, cache_.node_count,
+                 node_traits::allocate(get_node_allocator(), 1));
+  }
+
+  // compact
+  // A position in the segments of the tree while its elements are repacked.
+  struct pack_cursor {
+    leaf_pointer leaf;
+    size_type slot;
+    size_type segment;
+    size_type index;
+  };
+
+  // The fewest groups of at most per children that still hold at least min
+  // children each, when count children are spread evenly.
+  static size_type pack_groups(size_type count, size_type per, size_type min) {
+    auto groups = (count + per - 1) / per;
+    while (groups > 1 && count / groups < min) --groups;
+    return groups;
+  }
+
+  static size_type pack_length(size_type count, size_type groups,
+                               size_type index) {
+    return count / groups + (index < count % groups ? 1 : 0);
+  }
+
+  static size_type pack_limit(std::size_t min, std::size_t max, double fill) {
+    auto limit =
+        static_cast<std::size_t>(std::ceil(static_cast<double>(max) * fill));
+    return static_cast<size_type>((std::min)((std::max)(limit, min), max));
+  }
+
+  size_type cursor_length(pack_cursor const& cursor, size_type segments,
+                          bool packed) const {
+    if (packed) return pack_length(get_size(), segments, cursor.segment);
+    return cursor.leaf->sizes[cursor.slot];
+  }
+
+  // Steps count elements forward, at most to the next segment.
+  void advance_cursor(pack_cursor& cursor, size_type segments, bool packed,
+                      size_type count) {
+    cursor.index += count;
+    if (cursor.index != cursor_length(cursor, segments, packed)) return;
+    cursor.index = 0;
+    ++cursor.segment;
+    if (++cursor.slot != cursor.leaf->length()) return;
+    cursor.leaf = cursor.leaf->next_pointer;
+    cursor.slot = 0;
+  }
+
+  // Steps count elements back, at most to the last of the previous segment.
+  void retreat_cursor(pack_cursor& cursor, size_type segments, bool packed,
+                      size_type count) {
+    if (cursor.index >= count) {
+      cursor.index -= count;
+      return;
+    }
+    --cursor.segment;
+    if (cursor.slot-- == 0) {
+      cursor.leaf = cursor.leaf->prev_pointer;
+      cursor.slot = cursor.leaf->length() - 1;
+    }
+    cursor.index = cursor_length(cursor, segments, packed) - 1;
+  }
+
+  static bool cursor_less(pack_cursor const& a, pack_cursor const& b) {
+    return a.segment < b.segment ||
+           (a.segment == b.segment && a.index < b.index);
+  }
+
+  void relocate_range_segment(element_pointer source, size_type source_index,
+                              element_pointer dest, size_type dest_index,
+                              size_type count, size_type, bool,
+                              std::true_type) {
+    std::memmove(static_cast<void*>(std::addressof(dest[dest_index])),
+                 std::addressof(source[source_index]), count * sizeof(T));
+  }
+
+  void relocate_range_segment(element_pointer source, size_type source_index,
+                              element_pointer dest, size_type dest_index,
+                              size_type count, size_type live, bool backward,
+                              std::false_type) {
+    for (size_type i = 0; i != count; ++i) {
+      auto j = backward ? count - 1 - i : i;
+      if (dest_index + j < live)
+        assign_segment(dest, dest_index + j,
+                       std::move(source[source_index + j]));
+      else
+        construct_segment(dest, dest_index + j,
+                          std::move(source[source_index + j]));
+    }
+  }
+
+  // Moves count elements from source to dest, front to back or, if backward,
+  // back to front ending at the cursors. Slots past the old length of a
+  // segment hold no element yet.
+  void relocate_elements(pack_cursor const& source, pack_cursor const& dest,
+                         size_type count, bool backward) {
+    auto from = static_traits::cast_segment(source.leaf->pointers[source.slot]);
+    auto to = static_traits::cast_segment(dest.leaf->pointers[dest.slot]);
+    auto source_index = source.index;
+    auto dest_index = dest.index;
+    if (backward) {
+      source_index -= count - 1;
+      dest_index -= count - 1;
+    }
+    relocate_range_segment(from, source_index, to, dest_index, count,
+                           dest.leaf->sizes[dest.slot], backward,
+                           relocate_bitwise{});
+  }
+
+  // Moves the elements of every segment to the front of its block, where
+  // compact_elements expects them.
+  void compact_offsets(leaf_pointer pointer) {
+    for (; pointer != nullptr; pointer = pointer->next_pointer) {
       for (size_type i = 0, e = pointer->length(); i != e; ++i) {
-        purge_segment(static_traits::cast_segment(pointer->pointers[i]),
-                      pointer->sizes[i]);
+        pointer->pointers[i] = slide_backward_segment(
+            static_traits::cast_segment(pointer->pointers[i]),
+            pointer->sizes[i], pointer->offset(i));
+        pointer->offset(i, 0);
+      }
+    }
+  }
+
+  // Moves every element to its place when spread evenly over the first
+  // segments segments. Elements moving forward are moved front to back and
+  // elements moving backward back to front, so no element is overwritten
+  // before it is moved. Both passes go in runs that end with the source or
+  // the destination segment.
+  void compact_elements(leaf_pointer first, size_type segments) {
+    pack_cursor source{first, 0, 0, 0};
+    pack_cursor dest{first, 0, 0, 0};
+    size_type count;
+    for (auto left = get_size();; left -= count) {
+      count = (std::min)(
+          {left, cursor_length(source, segments, false) - source.index,
+           cursor_length(dest, segments, true) - dest.index});
+      if (cursor_less(dest, source))
+        relocate_elements(source, dest, count, false);
+      if (left == count) break;
+      advance_cursor(source, segments, false, count);
+      advance_cursor(dest, segments, true, count);
+    }
+
+    source.index += count - 1;
+    dest.index += count - 1;
+    for (auto left = get_size();; left -= count) {
+      count = (std::min)({left, source.index + 1, dest.index + 1});
+      if (cursor_less(source, dest))
+        relocate_elements(source, dest, count, true);
+      if (left == count) break;
+      retreat_cursor(source, segments, false, count);
+      retreat_cursor(dest, segments, true, count);
+    }
+  }
+
+  // Destroys the moved from elements, frees the old leaf nodes and the
+  // segments left empty, and chains the first segments segments into leaves
+  // new leaf nodes. Returns the first new leaf node, or the only segment.
+  void_pointer compact_leaves(leaf_pointer pointer, size_type segments,
+                              size_type leaves, bool packed) {
+    void_pointer first = nullptr;
+    leaf_pointer last = nullptr;
+    size_type segment = 0;
+    size_type leaf = 0;
+
+    while (pointer != nullptr) {
+      for (size_type i = 0, e = pointer->length(); i != e; ++i, ++segment) {
+        auto child = static_traits::cast_segment(pointer->pointers[i]);
+        size_type length = pointer->sizes[i];
+        auto offset = pointer->offset(i);
+        size_type keep = 0;
+        if (segment < segments)
+          keep = packed ? pack_length(get_size(), segments, segment) : length;
+        // Elements relocated bitwise leave nothing behind to destroy.
+        if (!relocate_bitwise::value)
+          for (auto j = keep; j < length; ++j) destroy_segment(child, j);
+        destroy_leaf(pointer, i);
+
+        if (segment >= segments) {
+          deallocate_segment(segment_base(child, offset));
+          continue;
+        }
+
+        // The root segment starts at the front of its block.
+        if (leaves == 0) {
+          first = slide_backward_segment(child, keep, offset);
+          continue;
+        }
+
+        if (last == nullptr ||
+            last->length() == pack_length(segments, leaves, leaf - 1)) {
+          auto alloc = allocate_leaf(last);
+          alloc->parent_pointer = nullptr;
+          alloc->length(0);
+          alloc->prev_pointer = last;
+          alloc->next_pointer = nullptr;
+          if (last == nullptr)
+            first = alloc;
+          else
+            last->next_pointer = alloc;
+          last = alloc;
+          ++leaf;
+        }
+
+        construct_leaf(last, last->length(), keep, child, offset);
+        last->length(last->length() + 1);
+      }
+
+      auto next = pointer->next_pointer;
+      deallocate_leaf(pointer);
+      pointer = next;
+    }
+
+    return first;
+  }
+
+  void compact_branches(node_pointer pointer, size_type ht) {
+    if (ht != 3) {
+      for (size_type i = 0, e = pointer->length(); i != e; ++i)
+        compact_branches(static_traits::cast_node(pointer->pointers[i]),
+                         ht - 1);
+    }
+    for (size_type i = 0, e = pointer->length(); i != e; ++i)
+      destroy_node(pointer, i);
+    deallocate_node(pointer);
+  }
+
+  static size_type child_size(void_pointer pointer, size_type ht) {
+    size_type sz = 0;
+    if (ht == 2) {
+      auto leaf = static_traits::cast_leaf(pointer);
+      for (size_type i = 0, e = leaf->length(); i != e; ++i)
+        sz += leaf->sizes[i];
+    } else {
+      auto node = static_traits::cast_node(pointer);
+      for (size_type i = 0, e = node->length(); i != e; ++i)
+        sz += node->sizes[i];
+    }
+    return sz;
+  }
+
+  // Builds index nodes over count children until one root is left. Leaf
+  // nodes are chained through next_pointer, the index nodes of a level are
+  // chained through parent_pointer until their own parent is assigned.
+  void compact_root(void_pointer first, size_type count, size_type per) {
+    size_type ht = 2;
+    while (count != 1) {
+      auto groups = pack_groups(count, per, static_traits::base_min());
+      node_pointer head = nullptr;
+      node_pointer last = nullptr;
+      auto child = first;
+
+      for (size_type group = 0; group != groups; ++group) {
+        auto alloc = allocate_node();
+        alloc->parent_pointer = nullptr;
+        auto length = pack_length(count, groups, group);
+        for (size_type i = 0; i != length; ++i) {
+          void_pointer next;
+          if (ht == 2)
+            next = static_traits::cast_leaf(child)->next_pointer;
+          else
+            next = static_traits::cast_node(child)->parent_pointer;
+          construct_branch(alloc, i, child_size(child, ht), child);
+          child = next;
+        }
+        alloc->length(length);
+
+        if (last == nullptr)
+          head = alloc;
+        else
+          last->parent_pointer = alloc;
+        last = alloc;
+      }
+
+      first = head;
+      count = groups;
+      ++ht;
+    }
+
+    get_root() = first;
+    get_height() = ht;
+  }
+
+  void compact_tree(double fill) {
+    if (get_height() < 2) return;
+
+    size_type segments = 0;
+    size_type leaves = 0;
+    size_type nodes = 0;
+    count_blocks(get_root(), get_height(), segments, leaves, nodes);
+
+    constexpr bool packed = relocate_bitwise::value ||
+                            (std::is_nothrow_move_constructible<T>::value &&
+                             std::is_nothrow_move_assignable<T>::value);
+    if (packed) {
+      auto per = pack_limit(segment_min(), segment_max(), fill);
+      segments = (std::min)(
+          segments,
+          pack_groups(get_size(), per, segment_min()));
+    }
+
+    auto leaf_per =
+        pack_limit(static_traits::leaf_min(), static_traits::leaf_max(), fill);
+    auto base_per =
+        pack_limit(static_traits::base_min(), static_traits::base_max(), fill);
+    leaves = 0;
+    nodes = 0;
+    if (segments != 1) {
+      leaves = pack_groups(segments, leaf_per, static_traits::leaf_min());
+      for (auto count = leaves; count != 1;) {
+        count = pack_groups(count, base_per, static_traits::base_min());
+        nodes += count;
+      }
+    }
+    fill_cache(0, leaves, nodes);
+
+    auto root = get_root();
+    auto ht = get_height();
+    auto first = static_traits::find_first_node(root, ht).leaf.pointer;
+    if (packed) {
+      if (static_traits::floating_segments()) compact_offsets(first);
+      compact_elements(first, segments);
+    }
+    auto child = compact_leaves(first, segments, leaves, packed);
+    if (ht != 2) compact_branches(static_traits::cast_node(root), ht);
+
+    if (leaves == 0) {
+      get_root() = child;
+      root_capacity_ = segment_max();
+      get_height() = 1;
+    } else
+      compact_root(child, leaves, base_per);
+  }
+
+  // purge
+  void purge() { purge_root(get_root(), get_size(), get_height()); }
+
+  void purge_segment(element_pointer, size_type, std::true_type) {}
+
+  void purge_segment(element_pointer pointer, size_type sz, std::false_type) {
+    for (size_type i = 0, e = sz; i != e; ++i) destroy_segment(pointer, i);
+  }
+
+  void purge_segment(element_pointer pointer, size_type sz,
+                     size_type offset = 0) {
+    purge_segment(
+        pointer, sz,
+        std::integral_constant<bool,
+                               std::is_trivially_destructible<T>::value>{});
+    deallocate_segment(segment_base(pointer, offset));
+  }
+
+  void purge_leaf(leaf_pointer pointer) {
+    for (size_type i = 0, e = pointer->length(); i != e; ++i) {
+      purge_segment(static_traits::cast_segment(pointer->pointers[i]),
+                    pointer->sizes[i], pointer->offset(i));
+      destroy_leaf(pointer, i);
+    }
+    deallocate_leaf(pointer);
+  }
+
+  void purge_node(node_pointer pointer, size_type ht) {
+    if (ht == 3) {
+      for (size_type i = 0, e = pointer->length(); i != e; ++i) {
+        purge_leaf(static_traits::cast_leaf(pointer->pointers[i]));
         destroy_node(pointer, i);
       }
     } else {
@@ -1263,8 +2343,16 @@ class seq {
   }
 
   void purge_root(void_pointer pointer, size_type sz, size_type ht) {
-    if (ht < 2)
-      purge_segment(static_traits::cast_segment(pointer), sz);
+    if (ht == 0) return;
+
+    if (ht == 1) {
+      auto segment = static_traits::cast_segment(pointer);
+      purge_segment(segment, sz,
+                    std::integral_constant<
+                        bool, std::is_trivially_destructible<T>::value>{});
+      deallocate_root(segment, root_capacity_);
+    } else if (ht == 2)
+      purge_leaf(static_traits::cast_leaf(pointer));
     else
       purge_node(static_traits::cast_node(pointer), ht);
   }
@@ -1277,9 +2365,13 @@ class seq {
     return 1;
   }
 
-  size_type construct_leaf(node_pointer pointer, size_type index,
-                           std::size_t child_sz, void_pointer child_pointer) {
-    pointer->sizes[index] = child_sz;
+  size_type construct_leaf(leaf_pointer pointer, size_type index,
+                           std::size_t child_sz, void_pointer child_pointer,
+                           size_type offset = 0) {
+    pointer->sizes[index] =
+        static_cast<typename static_traits::leaf_size_type>(child_sz);
+    pointer->offset(index, offset);
+    link_segment(pointer, index, child_pointer, offset);
     ::new (static_cast<void*>(std::addressof(pointer->pointers[index]))) auto(
         child_pointer);
     return child_sz;
@@ -1288,7 +2380,7 @@ class seq {
   size_type construct_branch(node_pointer pointer, size_type index,
                              std::size_t child_sz, void_pointer child_pointer) {
     pointer->sizes[index] = child_sz;
-    auto child = static_traits::cast_node(child_pointer);
+    auto child = static_traits::cast_base(child_pointer);
     child->parent_pointer = pointer;
     child->parent_index(index);
     ::new (static_cast<void*>(std::addressof(pointer->pointers[index]))) auto(
@@ -1303,9 +2395,13 @@ class seq {
     return 1;
   }
 
-  size_type assign_leaf(node_pointer pointer, size_type index,
-                        std::size_t child_sz, void_pointer child_pointer) {
-    pointer->sizes[index] = child_sz;
+  size_type assign_leaf(leaf_pointer pointer, size_type index,
+                        std::size_t child_sz, void_pointer child_pointer,
+                        size_type offset = 0) {
+    pointer->sizes[index] =
+        static_cast<typename static_traits::leaf_size_type>(child_sz);
+    pointer->offset(index, offset);
+    link_segment(pointer, index, child_pointer, offset);
     pointer->pointers[index] = child_pointer;
     return child_sz;
   }
@@ -1313,7 +2409,7 @@ class seq {
   size_type assign_branch(node_pointer pointer, size_type index,
                           std::size_t child_sz, void_pointer child_pointer) {
     pointer->sizes[index] = child_sz;
-    auto child = static_traits::cast_node(child_pointer);
+    auto child = static_traits::cast_base(child_pointer);
     child->parent_pointer = pointer;
     child->parent_index(index);
     pointer->pointers[index] = child_pointer;
@@ -1327,10 +2423,11 @@ class seq {
     return 1;
   }
 
-  size_type move_assign_leaf(node_pointer source, size_type source_index,
-                             node_pointer dest, size_type dest_index) {
+  size_type move_assign_leaf(leaf_pointer source, size_type source_index,
+                             leaf_pointer dest, size_type dest_index) {
     return assign_leaf(dest, dest_index, source->sizes[source_index],
-                       source->pointers[source_index]);
+                       source->pointers[source_index],
+                       source->offset(source_index));
   }
 
   size_type move_assign_branch(node_pointer source, size_type source_index,
@@ -1346,11 +2443,12 @@ class seq {
     return 1;
   }
 
-  size_type move_leaf(node_pointer source, size_type source_index,
-                      node_pointer dest, size_type dest_index) {
+  size_type move_leaf(leaf_pointer source, size_type source_index,
+                      leaf_pointer dest, size_type dest_index) {
     auto child_sz = source->sizes[source_index];
     auto child_pointer = source->pointers[source_index];
-    construct_leaf(dest, dest_index, child_sz, child_pointer);
+    construct_leaf(dest, dest_index, child_sz, child_pointer,
+                   source->offset(source_index));
     return child_sz;
   }
 
@@ -1363,10 +2461,23 @@ class seq {
   }
 
   // construct_range
+  // Whether elements may be moved into raw slots with memcpy or memmove,
+  // bypassing the allocator's construct, and destroy unless they are trivially
+  // copyable.
+  using relocate_bitwise = std::integral_constant<
+      bool,
+      is_trivially_relocatable<T>::value &&
+          (std::is_same<allocator_type, std::allocator<value_type>>::value ||
+           (detail::is_alloc_move_construct_default<value_type,
+                                                    allocator_type>::value &&
+            (std::is_trivially_copyable<T>::value ||
+             detail::is_alloc_destroy_default<value_type,
+                                              allocator_type>::value)))>;
+
   void construct_range_segment(element_pointer source, size_type source_index,
                                element_pointer dest, size_type dest_index,
                                size_type count, std::true_type) {
-    std::memcpy(std::addressof(dest[dest_index]),
+    std::memcpy(static_cast<void*>(std::addressof(dest[dest_index])),
                 std::addressof(source[source_index]), count * sizeof(T));
   }
 
@@ -1389,19 +2500,13 @@ class seq {
                                     size_type source_index,
                                     element_pointer dest, size_type dest_index,
                                     size_type count) {
-    construct_range_segment(
-        source, source_index, dest, dest_index, count,
-        std::integral_constant < bool,
-        std::is_trivially_copyable<T>::value &&
-            (std::is_same<allocator_type, std::allocator<value_type>>::value ||
-             detail::is_alloc_move_construct_default<value_type,
-                                                     allocator_type>::value) >
-                {});
+    construct_range_segment(source, source_index, dest, dest_index, count,
+                            relocate_bitwise{});
     return count;
   }
 
-  size_type construct_range_leaf(node_pointer source, size_type source_index,
-                                 node_pointer dest, size_type dest_index,
+  size_type construct_range_leaf(leaf_pointer source, size_type source_index,
+                                 leaf_pointer dest, size_type dest_index,
                                  size_type count) {
     size_type copy_size = 0;
     auto from = source_index;
@@ -1463,7 +2568,7 @@ class seq {
         std::integral_constant<bool, std::is_trivially_copyable<T>::value>{});
   }
 
-  void assign_forward_leaf(node_pointer pointer, size_type length,
+  void assign_forward_leaf(leaf_pointer pointer, size_type length,
                            size_type index, size_type distance) {
     auto first = index;
     auto from = length;
@@ -1519,7 +2624,7 @@ class seq {
         std::integral_constant<bool, std::is_trivially_copyable<T>::value>{});
   }
 
-  void assign_backward_leaf(node_pointer pointer, size_type length,
+  void assign_backward_leaf(leaf_pointer pointer, size_type length,
                             size_type index, size_type distance) {
     auto from = index + distance;
     auto to = index;
@@ -1538,65 +2643,774 @@ class seq {
     auto to = index;
     auto last = length;
 
-    while (to != last) {
-      move_assign_branch(pointer, from, pointer, to);
-      ++from;
-      ++to;
-    }
+    while (to != last) {
+      move_assign_branch(pointer, from, pointer, to);
+      ++from;
+      ++to;
+    }
+  }
+
+  // slide
+  void slide_forward_segment(element_pointer pointer, size_type length,
+                             size_type distance, std::true_type) {
+    std::memmove(static_cast<void*>(std::addressof(pointer[distance])),
+                 std::addressof(pointer[0]), length * sizeof(T));
+  }
+
+  void slide_forward_segment(element_pointer pointer, size_type length,
+                             size_type distance, std::false_type) {
+    auto from = length;
+    auto to = length + distance;
+    while (from != 0 && to != length) {
+      --from;
+      --to;
+      move_segment(pointer, from, pointer, to);
+    }
+    assign_forward_segment(pointer, from, 0, distance);
+    for (size_type i = 0, e = (std::min)(length, distance); i != e; ++i)
+      destroy_segment(pointer, i);
+  }
+
+  // Moves the length elements at pointer distance slots towards the end of
+  // their block. Returns their new start.
+  element_pointer slide_forward_segment(element_pointer pointer,
+                                        size_type length, size_type distance) {
+    if (distance == 0) return pointer;  // Avoids self move assignment.
+    slide_forward_segment(pointer, length, distance, relocate_bitwise{});
+    return pointer + static_cast<difference_type>(distance);
+  }
+
+  void slide_backward_segment(element_pointer pointer, size_type length,
+                              size_type distance, std::true_type) {
+    std::memmove(static_cast<void*>(std::addressof(pointer[0])),
+                 std::addressof(pointer[distance]), length * sizeof(T));
+  }
+
+  void slide_backward_segment(element_pointer pointer, size_type length,
+                              size_type distance, std::false_type) {
+    auto source = pointer + static_cast<difference_type>(distance);
+    auto fresh = (std::min)(length, distance);
+    for (size_type i = 0; i != fresh; ++i) move_segment(source, i, pointer, i);
+    assign_backward_segment(pointer, length, fresh, distance);
+    for (auto i = length - fresh; i != length; ++i) destroy_segment(source, i);
+  }
+
+  // Moves the length elements at pointer distance slots towards the front of
+  // their block. Returns their new start.
+  element_pointer slide_backward_segment(element_pointer pointer,
+                                         size_type length, size_type distance) {
+    if (distance == 0) return pointer;  // Avoids self move assignment.
+    auto start = segment_base(pointer, distance);
+    slide_backward_segment(start, length, distance, relocate_bitwise{});
+    return start;
+  }
+
+  // update_sizes
+  void update_sizes(node_pointer pointer, size_type index, size_type sz) {
+    while (pointer != nullptr) {
+      pointer->sizes[index] += sz;
+      index = pointer->parent_index();
+      pointer = pointer->parent_pointer;
+    }
+
+    get_size() += sz;
+  }
+
+  void update_sizes(leaf_pointer pointer, size_type index, size_type sz) {
+    if (pointer == nullptr) {
+      get_size() += sz;
+      return;
+    }
+
+    // Wraps modulo the narrower type, which still yields the right size.
+    pointer->sizes[index] = static_cast<typename static_traits::leaf_size_type>(
+        pointer->sizes[index] + sz);
+    update_sizes(pointer->parent_pointer, pointer->parent_index(), sz);
+  }
+
+  template <typename Pointer>
+  void increment_sizes(Pointer pointer, size_type index, std::size_t by = 1) {
+    update_sizes(pointer, index, by);
+  }
+
+  template <typename Pointer>
+  void decrement_sizes(Pointer pointer, size_type index, std::size_t by = 1) {
+    update_sizes(pointer, index, ~by + 1);
+  }
+
+  // offset
+  static size_type segment_offset(leaf_pointer pointer, size_type index) {
+    return pointer == nullptr ? 0 : pointer->offset(index);
+  }
+
+  static element_pointer segment_base(element_pointer pointer,
+                                      size_type offset) {
+    return pointer - static_cast<difference_type>(offset);
+  }
+
+  // parent
+  using segment_parent = typename static_traits::segment_parent;
+
+  // Records in front of the block of the segment at child_pointer, whose
+  // elements start offset into it, that it hangs from pointer at index.
+  static void link_segment(leaf_pointer pointer, size_type index,
+                           void_pointer child_pointer, size_type offset) {
+    if (!static_traits::back_pointers()) return;
+    segment_parent parent;
+    parent.parent_pointer = pointer;
+    parent.parent_index = static_cast<std::uint16_t>(index);
+    auto record = segment_base(static_traits::cast_segment(child_pointer),
+                               offset + static_traits::parent_length());
+    std::memcpy(static_cast<void*>(std::addressof(record[0])), &parent,
+                sizeof(parent));
+  }
+
+  // Records that the elements of the segment at index now start at start.
+  static void segment_start(leaf_pointer pointer, size_type index,
+                            element_pointer start) {
+    auto old = static_traits::cast_segment(pointer->pointers[index]);
+    // Wraps modulo size_type when the elements moved towards the front.
+    auto moved = static_cast<size_type>(start - old);
+    pointer->offset(index, pointer->offset(index) + moved);
+    pointer->pointers[index] = start;
+  }
+
+  // link
+  void link_leaf(leaf_pointer pointer, leaf_pointer alloc) {
+    auto next_pointer = pointer->next_pointer;
+    alloc->prev_pointer = pointer;
+    alloc->next_pointer = next_pointer;
+    if (next_pointer != nullptr) next_pointer->prev_pointer = alloc;
+    pointer->next_pointer = alloc;
+  }
+
+  void unlink_leaf(leaf_pointer pointer) {
+    auto prev_pointer = pointer->prev_pointer;
+    auto next_pointer = pointer->next_pointer;
+    if (prev_pointer != nullptr) prev_pointer->next_pointer = next_pointer;
+    if (next_pointer != nullptr) next_pointer->prev_pointer = prev_pointer;
+  }
+
+  // alloc_nodes_single
+  // Allocates the leaf and the index nodes a full leaf splits into, chained
+  // bottom up through parent_pointer. Returns nullptr if nothing splits.
+  leaf_pointer alloc_nodes_single(leaf_pointer pointer,
+                                  element_pointer segment_alloc) {
+    if (pointer != nullptr && (pointer->length() != static_traits::leaf_max() ||
+                               sibling_has_room(pointer)))
+      return nullptr;
+
+    leaf_pointer alloc = nullptr;
+    try {
+      alloc = allocate_leaf(pointer);
+      alloc->parent_pointer = nullptr;
+      if (pointer == nullptr) return alloc;
+
+      auto tail = std::addressof(alloc->parent_pointer);
+      auto parent_pointer = pointer->parent_pointer;
+      while (true) {
+        if (parent_pointer != nullptr &&
+            (parent_pointer->length() != static_traits::base_max() ||
+             sibling_has_room(parent_pointer)))
+          return alloc;
+
+        auto temp = allocate_node();
+        temp->parent_pointer = nullptr;
+        *tail = temp;
+        tail = std::addressof(temp->parent_pointer);
+
+        if (parent_pointer == nullptr) return alloc;
+        parent_pointer = parent_pointer->parent_pointer;
+      }
+    } catch (...) {
+      deallocate_segment(segment_alloc);
+
+      if (alloc != nullptr) {
+        auto next = alloc->parent_pointer;
+        deallocate_leaf(alloc);
+
+        while (next != nullptr) {
+          auto temp = next->parent_pointer;
+          deallocate_node(next);
+          next = temp;
+        }
+      }
+      throw;
+    }
+  }
+
+  // redistribute
+  // Finds how many more children the siblings of pointer under the same parent
+  // can take.
+  template <typename Pointer>
+  static void sibling_room(Pointer pointer, size_type max,
+                           size_type& prev_room, size_type& next_room) {
+    prev_room = 0;
+    next_room = 0;
+    auto parent_pointer = pointer->parent_pointer;
+    if (parent_pointer == nullptr) return;
+
+    auto index = pointer->parent_index();
+    auto pointers = &parent_pointer->pointers[0];
+    if (index != 0)
+      prev_room = max - static_traits::cast_base(pointers[index - 1])->length();
+    if (index + 1 != parent_pointer->length())
+      next_room = max - static_traits::cast_base(pointers[index + 1])->length();
+  }
+
+  static bool sibling_has_room(leaf_pointer pointer) {
+    if (!static_traits::redistribute()) return false;
+    size_type prev_room, next_room;
+    sibling_room(pointer, static_traits::leaf_max(), prev_room, next_room);
+    return prev_room != 0 || next_room != 0;
+  }
+
+  static bool sibling_has_room(node_pointer pointer) {
+    if (!static_traits::redistribute()) return false;
+    size_type prev_room, next_room;
+    sibling_room(pointer, static_traits::base_max(), prev_room, next_room);
+    return prev_room != 0 || next_room != 0;
+  }
+
+  // How many children a full block passes to a sibling with room. Half the
+  // room evens out the two, but at least one unless the insertion point is at
+  // the far end, where the new child goes to the sibling instead. At the near
+  // end, as in a run of insertions there, the sibling is filled up at once so
+  // that the run doesn't come back to shift a few children at a time.
+  static size_type shift_count(size_type room, bool at_far_end,
+                               bool at_near_end = false) {
+    if (static_traits::edge_split() && at_near_end) return room;
+    auto count = room / 2;
+    if (count == 0 && !at_far_end) count = 1;
+    return count;
+  }
+
+  // How many of the max + 1 children a full block keeps when it splits. At
+  // an edge the block the insertion went to starts at the minimum and fills up
+  // with the children that follow, while shifts top up the other one. first
+  // is the lowest index a child can be inserted at.
+  static size_type split_length(size_type max, size_type min, size_type first,
+                                size_type index) {
+    if (static_traits::edge_split()) {
+      if (index == max) return max + 1 - min;
+      if (index == first) return min;
+    }
+    return (max + 1) / 2;
+  }
+
+  // Moves the last count elements of source to the front of dest, using the
+  // free slots before dest first. Updates dest to its new start.
+  void move_tail_segment(element_pointer source, size_type source_length,
+                         element_pointer& dest, size_type dest_offset,
+                         size_type dest_length, size_type count) {
+    auto front = (std::min)(dest_offset, count);
+    dest = slide_forward_segment(dest, dest_length, count - front);
+    dest = segment_base(dest, count);
+    construct_range_segment(source, source_length - count, dest, 0, count);
+  }
+
+  // Moves the first count elements of source to the back of dest, using the
+  // free slots after dest first. Updates source and dest to their new starts.
+  void move_head_segment(element_pointer& source, size_type source_length,
+                         element_pointer& dest, size_type dest_offset,
+                         size_type dest_length, size_type count) {
+    auto back = segment_max() - dest_offset - dest_length;
+    if (back < count)
+      dest = slide_backward_segment(dest, dest_length, count - back);
+    construct_range_segment(source, 0, dest, dest_length, count);
+    source += static_cast<difference_type>(count);
+    if (!static_traits::floating_segments())
+      source = slide_backward_segment(source, source_length - count, count);
+  }
+
+  size_type move_tail_leaf(leaf_pointer source, leaf_pointer dest,
+                           size_type count) {
+    auto source_length = source->length();
+    auto dest_length = dest->length();
+    auto from = dest_length;
+    auto to = dest_length + count;
+    while (from != 0 && to != dest_length) {
+      --from;
+      --to;
+      move_leaf(dest, from, dest, to);
+    }
+    assign_forward_leaf(dest, from, 0, count);
+
+    size_type moved = 0;
+    auto first = source_length - count;
+    for (size_type i = 0; i != count; ++i) {
+      if (i < dest_length)
+        moved += move_assign_leaf(source, first + i, dest, i);
+      else
+        moved += move_leaf(source, first + i, dest, i);
+      destroy_leaf(source, first + i);
+    }
+    source->length(first);
+    dest->length(dest_length + count);
+    return moved;
+  }
+
+  size_type move_head_leaf(leaf_pointer source, leaf_pointer dest,
+                           size_type count) {
+    auto source_length = source->length();
+    auto dest_length = dest->length();
+    size_type moved = 0;
+    for (size_type i = 0; i != count; ++i)
+      moved += move_leaf(source, i, dest, dest_length + i);
+    assign_backward_leaf(source, source_length - count, 0, count);
+    for (auto i = source_length - count; i != source_length; ++i)
+      destroy_leaf(source, i);
+    source->length(source_length - count);
+    dest->length(dest_length + count);
+    return moved;
+  }
+
+  size_type move_tail_branch(node_pointer source, node_pointer dest,
+                             size_type count) {
+    auto source_length = source->length();
+    auto dest_length = dest->length();
+    auto from = dest_length;
+    auto to = dest_length + count;
+    while (from != 0 && to != dest_length) {
+      --from;
+      --to;
+      move_branch(dest, from, dest, to);
+    }
+    assign_forward_branch(dest, from, 0, count);
+
+    size_type moved = 0;
+    auto first = source_length - count;
+    for (size_type i = 0; i != count; ++i) {
+      if (i < dest_length)
+        moved += move_assign_branch(source, first + i, dest, i);
+      else
+        moved += move_branch(source, first + i, dest, i);
+      destroy_node(source, first + i);
+    }
+    source->length(first);
+    dest->length(dest_length + count);
+    return moved;
+  }
+
+  size_type move_head_branch(node_pointer source, node_pointer dest,
+                             size_type count) {
+    auto source_length = source->length();
+    auto dest_length = dest->length();
+    size_type moved = 0;
+    for (size_type i = 0; i != count; ++i)
+      moved += move_branch(source, i, dest, dest_length + i);
+    assign_backward_branch(source, source_length - count, 0, count);
+    for (auto i = source_length - count; i != source_length; ++i)
+      destroy_node(source, i);
+    source->length(source_length - count);
+    dest->length(dest_length + count);
+    return moved;
+  }
+
+  // Puts value at index, moving the elements from index to length one slot
+  // towards the back.
+  void insert_tail_segment(element_pointer pointer, size_type length,
+                           size_type index, value_type& value, std::true_type) {
+    std::memmove(static_cast<void*>(std::addressof(pointer[index + 1])),
+                 std::addressof(pointer[index]), (length - index) * sizeof(T));
+    construct_segment(pointer, index, std::move(value));
+  }
+
+  void insert_tail_segment(element_pointer pointer, size_type length,
+                           size_type index, value_type& value,
+                           std::false_type) {
+    if (index != length) {
+      move_segment(pointer, length - 1, pointer, length);
+      assign_forward_segment(pointer, length - 1, index, 1);
+      assign_segment(pointer, index, std::move(value));
+    } else
+      construct_segment(pointer, index, std::move(value));
+  }
+
+  // Puts value at index, moving the index elements before it one slot towards
+  // the front, to start.
+  void insert_head_segment(element_pointer start, size_type index,
+                           value_type& value, std::true_type) {
+    std::memmove(static_cast<void*>(std::addressof(start[0])),
+                 std::addressof(start[1]), index * sizeof(T));
+    construct_segment(start, index, std::move(value));
+  }
+
+  void insert_head_segment(element_pointer start, size_type index,
+                           value_type& value, std::false_type) {
+    if (index != 0) {
+      move_segment(start, 1, start, 0);
+      assign_backward_segment(start, index, 1, 1);
+      assign_segment(start, index, std::move(value));
+    } else
+      construct_segment(start, 0, std::move(value));
+  }
+
+  // Inserts into a block that is known not to be full. If floating is set,
+  // the fewer elements before or after index move, and when their side of the
+  // block is full, half the free slots on the other side are moved over first,
+  // or all of them for an insertion at either end. Returns the new start of
+  // the segment.
+  element_pointer insert_room_segment(element_pointer pointer, size_type offset,
+                                      size_type length, size_type index,
+                                      value_type& value, bool floating) {
+    auto back = segment_max() - offset - length;
+    auto front = static_traits::floating_segments() && floating &&
+                 index < length - index;
+    auto edge = index == 0 || index == length;
+    if (front && offset == 0) {
+      if (back >= 2)
+        pointer = slide_forward_segment(pointer, length, edge ? back : back / 2);
+      else
+        front = false;
+    } else if (!front && back == 0) {
+      if (offset >= 2)
+        pointer =
+            slide_backward_segment(pointer, length, edge ? offset : offset / 2);
+      else
+        front = true;
+    }
+
+    if (!front) {
+      insert_tail_segment(pointer, length, index, value, relocate_bitwise{});
+      return pointer;
+    }
+
+    auto start = segment_base(pointer, 1);
+    insert_head_segment(start, index, value, relocate_bitwise{});
+    return start;
+  }
+
+  // Erases from a segment that keeps length elements. If floating is set, the
+  // fewer elements before or after index move. Returns the new start of the
+  // segment.
+  element_pointer erase_room_segment(element_pointer pointer, size_type length,
+                                     size_type index, bool floating) {
+    if (static_traits::floating_segments() && floating &&
+        index < length - index) {
+      erase_head_segment(pointer, index, relocate_bitwise{});
+      return pointer + 1;
+    }
+
+    erase_tail_segment(pointer, length, index, relocate_bitwise{});
+    return pointer;
+  }
+
+  // Removes the element at index, moving the elements after it, up to length
+  // of them, one slot towards the front.
+  void erase_tail_segment(element_pointer pointer, size_type length,
+                          size_type index, std::true_type) {
+    destroy_segment(pointer, index);
+    std::memmove(static_cast<void*>(std::addressof(pointer[index])),
+                 std::addressof(pointer[index + 1]),
+                 (length - index) * sizeof(T));
+  }
+
+  void erase_tail_segment(element_pointer pointer, size_type length,
+                          size_type index, std::false_type) {
+    assign_backward_segment(pointer, length, index, 1);
+    destroy_segment(pointer, length);
   }
 
-  // update_sizes
-  void update_sizes(node_pointer pointer, size_type index, size_type sz) {
-    while (pointer != nullptr) {
-      pointer->sizes[index] += sz;
-      index = pointer->parent_index();
-      pointer = pointer->parent_pointer;
-    }
+  // Removes the element at index, moving the index elements before it one
+  // slot towards the back.
+  void erase_head_segment(element_pointer pointer, size_type index,
+                          std::true_type) {
+    destroy_segment(pointer, index);
+    std::memmove(static_cast<void*>(std::addressof(pointer[1])),
+                 std::addressof(pointer[0]), index * sizeof(T));
+  }
 
-    get_size() += sz;
+  void erase_head_segment(element_pointer pointer, size_type index,
+                          std::false_type) {
+    assign_forward_segment(pointer, index, 0, 1);
+    destroy_segment(pointer, 0);
   }
 
-  void increment_sizes(node_pointer pointer, size_type index,
-                       std::size_t by = 1) {
-    update_sizes(pointer, index, by);
+  void insert_room_leaf(leaf_pointer pointer, size_type index,
+                        size_type child_size, void_pointer child_pointer) {
+    auto length = pointer->length();
+    if (index != length) {
+      move_leaf(pointer, length - 1, pointer, length);
+      assign_forward_leaf(pointer, length - 1, index, 1);
+      assign_leaf(pointer, index, child_size, child_pointer);
+    } else
+      construct_leaf(pointer, index, child_size, child_pointer);
+    pointer->length(length + 1);
   }
 
-  void decrement_sizes(node_pointer pointer, size_type index,
-                       std::size_t by = 1) {
-    update_sizes(pointer, index, ~by + 1);
+  void insert_room_branch(node_pointer pointer, size_type index,
+                          size_type child_size, void_pointer child_pointer) {
+    auto length = pointer->length();
+    if (index != length) {
+      move_branch(pointer, length - 1, pointer, length);
+      assign_forward_branch(pointer, length - 1, index, 1);
+      assign_branch(pointer, index, child_size, child_pointer);
+    } else
+      construct_branch(pointer, index, child_size, child_pointer);
+    pointer->length(length + 1);
   }
 
-  // alloc_nodes_single
-  node_pointer alloc_nodes_single(node_pointer pointer,
-                                  element_pointer segment_alloc) {
-    node_pointer alloc = nullptr;
-    try {
-      while (true) {
-        if (pointer == nullptr) {
-          auto temp = allocate_node();
-          temp->parent_pointer = alloc;
-          alloc = temp;
-          return alloc;
-        }
+  // Inserts into a full segment by first passing elements to the sibling
+  // under the same leaf with the most room. Returns false if both are full.
+  bool insert_shift_segment(iterator_entry& entry, value_type& value) {
+    auto max = segment_max();
+    auto index = entry.segment.index();
+    auto parent_pointer = entry.leaf.pointer;
+    auto parent_index = entry.leaf.index();
+    auto pointers = &parent_pointer->pointers[0];
+    auto& sizes = parent_pointer->sizes;
+
+    size_type prev_room = 0;
+    size_type next_room = 0;
+    if (parent_index != 0) prev_room = max - sizes[parent_index - 1];
+    if (parent_index + 1 != parent_pointer->length())
+      next_room = max - sizes[parent_index + 1];
+    if (prev_room == 0 && next_room == 0) return false;
+
+    size_type left_index;
+    size_type left_length;
+    size_type position;
+    if (next_room >= prev_room) {
+      left_index = parent_index;
+      auto count = shift_count(next_room, index == max, index == 0);
+      auto next_index = parent_index + 1;
+      auto next = static_traits::cast_segment(pointers[next_index]);
+      move_tail_segment(entry.segment.pointer, max, next,
+                        parent_pointer->offset(next_index), sizes[next_index],
+                        count);
+      segment_start(parent_pointer, next_index, next);
+      left_length = max - count;
+      position = index;
+    } else {
+      left_index = parent_index - 1;
+      auto count = shift_count(prev_room, index == 0, index == max);
+      size_type prev_length = sizes[left_index];
+      auto prev = static_traits::cast_segment(pointers[left_index]);
+      auto source = entry.segment.pointer;
+      move_head_segment(source, max, prev, parent_pointer->offset(left_index),
+                        prev_length, count);
+      segment_start(parent_pointer, left_index, prev);
+      segment_start(parent_pointer, parent_index, source);
+      left_length = prev_length + count;
+      position = prev_length + index;
+    }
 
-        if (pointer->length() != static_traits::base_max()) return alloc;
+    size_type right_length =
+        sizes[left_index] + sizes[left_index + 1] - left_length;
+    sizes[left_index] =
+        static_cast<typename static_traits::leaf_size_type>(left_length);
+    sizes[left_index + 1] =
+        static_cast<typename static_traits::leaf_size_type>(right_length);
+
+    auto target_index = left_index;
+    auto length = left_length;
+    if (position > left_length || (position == left_length && length == max)) {
+      ++target_index;
+      position -= left_length;
+      length = right_length;
+    }
 
-        auto temp = allocate_node();
-        temp->parent_pointer = alloc;
-        alloc = temp;
+    auto target = insert_room_segment(
+        static_traits::cast_segment(pointers[target_index]),
+        parent_pointer->offset(target_index), length, position, value, true);
+    segment_start(parent_pointer, target_index, target);
+    entry.segment.pointer = target;
+    entry.segment.index(position);
+    entry.segment.length(length + 1);
+    entry.leaf.index(target_index);
+    increment_sizes(parent_pointer, target_index);
+    return true;
+  }
+
+  // Splits a full segment and its full sibling into three segments of two
+  // thirds each instead of splitting the one segment in half.
+  void insert_split_segment(iterator_entry& entry, value_type& value) {
+    auto max = segment_max();
+    auto left_length = 2 * max / 3;
+    auto alloc_length = (2 * max - left_length) / 2;
+    auto right_length = 2 * max - left_length - alloc_length;
 
-        pointer = pointer->parent_pointer;
-      }
-    } catch (...) {
-      deallocate_segment(segment_alloc);
+    auto parent_pointer = entry.leaf.pointer;
+    auto left_index = entry.leaf.index();
+    auto position = entry.segment.index();
+    if (left_index + 1 == parent_pointer->length()) {
+      --left_index;
+      position += max;
+    }
+    auto pointers = &parent_pointer->pointers[0];
+    auto left = static_traits::cast_segment(pointers[left_index]);
+    auto right = static_traits::cast_segment(pointers[left_index + 1]);
 
-      while (alloc != nullptr) {
-        auto temp = alloc->parent_pointer;
-        deallocate_node(alloc);
-        alloc = temp;
-      }
-      throw;
+    auto alloc = allocate_segment(
+        segment_base(left, parent_pointer->offset(left_index)));
+    auto leaf_alloc = alloc_nodes_single(parent_pointer, alloc);
+
+    construct_range_segment(left, left_length, alloc, 0, max - left_length);
+    move_head_segment(right, max, alloc, 0, max - left_length,
+                      left_length + alloc_length - max);
+    segment_start(parent_pointer, left_index + 1, right);
+
+    element_pointer target = left;
+    auto target_index = left_index;
+    auto length = left_length;
+    size_type offset = 0;
+    if (position > left_length + alloc_length) {
+      target = right;
+      target_index = left_index + 2;
+      position -= left_length + alloc_length;
+      length = right_length;
+      offset = parent_pointer->offset(left_index + 1);
+    } else if (position > left_length) {
+      target = alloc;
+      target_index = left_index + 1;
+      position -= left_length;
+      length = alloc_length;
+    }
+    // alloc only gets its entry in the leaf below, so it stays in place.
+    auto start = insert_room_segment(target, offset, length, position, value,
+                                     target != alloc);
+    if (target == left) segment_start(parent_pointer, left_index, start);
+    if (target == right) segment_start(parent_pointer, left_index + 1, start);
+
+    auto& sizes = parent_pointer->sizes;
+    size_type final_alloc = alloc_length + (target == alloc);
+    sizes[left_index] = static_cast<typename static_traits::leaf_size_type>(
+        left_length + (target == left) + final_alloc - 1);
+    sizes[left_index + 1] = static_cast<typename static_traits::leaf_size_type>(
+        right_length + (target == right));
+
+    entry.segment.pointer = start;
+    entry.segment.index(position);
+    entry.segment.length(length + 1);
+    entry.leaf.index(target_index);
+
+    insert_single_leaf(entry, left, parent_pointer, left_index + 1, leaf_alloc,
+                       alloc, final_alloc);
+  }
+
+  // Inserts a child into a full leaf that has a sibling with room under the
+  // same parent, see sibling_has_room.
+  void insert_shift_leaf(iterator_entry& entry, leaf_pointer pointer,
+                         size_type index, element_pointer child_pointer,
+                         size_type child_size) {
+    constexpr auto max = static_traits::leaf_max();
+    auto parent_pointer = pointer->parent_pointer;
+    auto parent_index = pointer->parent_index();
+    auto pointers = &parent_pointer->pointers[0];
+    auto& sizes = parent_pointer->sizes;
+
+    size_type prev_room, next_room;
+    sibling_room(pointer, max, prev_room, next_room);
+
+    leaf_pointer left;
+    leaf_pointer right;
+    size_type left_index;
+    size_type position;
+    size_type entry_position;
+    if (next_room >= prev_room) {
+      left_index = parent_index;
+      left = pointer;
+      right = static_traits::cast_leaf(pointers[left_index + 1]);
+      auto moved =
+          move_tail_leaf(left, right, shift_count(next_room, index == max));
+      sizes[left_index] -= moved;
+      sizes[left_index + 1] += moved;
+      position = index;
+      entry_position = entry.leaf.index();
+    } else {
+      left_index = parent_index - 1;
+      left = static_traits::cast_leaf(pointers[left_index]);
+      right = pointer;
+      auto prev_length = left->length();
+      auto moved =
+          move_head_leaf(right, left, shift_count(prev_room, index == 0));
+      sizes[left_index] += moved;
+      sizes[left_index + 1] -= moved;
+      position = prev_length + index;
+      entry_position = prev_length + entry.leaf.index();
+    }
+
+    // The size recorded for pointer doesn't count the child_size - 1 elements
+    // its previous child already lost to the new one.
+    sizes[parent_index] -= child_size - 1;
+    auto left_length = left->length();
+    auto target = left;
+    auto target_index = left_index;
+    if (position > left_length ||
+        (position == left_length && left_length == max)) {
+      target = right;
+      target_index = left_index + 1;
+      position -= left_length;
+    }
+    insert_room_leaf(target, position, child_size, child_pointer);
+    sizes[target_index] += child_size;
+
+    left_length = left->length();
+    if (entry_position < left_length) {
+      entry.leaf.pointer = left;
+      entry.leaf.index(entry_position);
+    } else {
+      entry.leaf.pointer = right;
+      entry.leaf.index(entry_position - left_length);
+    }
+    increment_sizes(parent_pointer->parent_pointer,
+                    parent_pointer->parent_index());
+  }
+
+  // Inserts a child into a full index node that has a sibling with room under
+  // the same parent, see sibling_has_room.
+  void insert_shift_branch(node_pointer pointer, size_type index,
+                           void_pointer child_pointer, size_type child_size) {
+    constexpr auto max = static_traits::base_max();
+    auto parent_pointer = pointer->parent_pointer;
+    auto parent_index = pointer->parent_index();
+    auto pointers = &parent_pointer->pointers[0];
+    auto& sizes = parent_pointer->sizes;
+
+    size_type prev_room, next_room;
+    sibling_room(pointer, max, prev_room, next_room);
+
+    node_pointer left;
+    node_pointer right;
+    size_type left_index;
+    size_type position;
+    if (next_room >= prev_room) {
+      left_index = parent_index;
+      left = pointer;
+      right = static_traits::cast_node(pointers[left_index + 1]);
+      auto moved =
+          move_tail_branch(left, right, shift_count(next_room, index == max));
+      sizes[left_index] -= moved;
+      sizes[left_index + 1] += moved;
+      position = index;
+    } else {
+      left_index = parent_index - 1;
+      left = static_traits::cast_node(pointers[left_index]);
+      right = pointer;
+      auto prev_length = left->length();
+      auto moved =
+          move_head_branch(right, left, shift_count(prev_room, index == 0));
+      sizes[left_index] += moved;
+      sizes[left_index + 1] -= moved;
+      position = prev_length + index;
+    }
+
+    sizes[parent_index] -= child_size - 1;
+    auto left_length = left->length();
+    auto target = left;
+    auto target_index = left_index;
+    if (position > left_length ||
+        (position == left_length && left_length == max)) {
+      target = right;
+      target_index = left_index + 1;
+      position -= left_length;
     }
+    insert_room_branch(target, position, child_size, child_pointer);
+    sizes[target_index] += child_size;
+
+    increment_sizes(parent_pointer->parent_pointer,
+                    parent_pointer->parent_index());
   }
 
   //   insert_single
@@ -1606,54 +3420,83 @@ class seq {
 
   void insert_single_segment(iterator_entry& entry, value_type value) {
     auto pointer = entry.segment.pointer;
-    auto index = entry.segment.index;
-    auto length = entry.segment.length;
+    auto index = entry.segment.index();
+    auto length = entry.segment.length();
     auto parent_pointer = entry.leaf.pointer;
-    auto parent_index = entry.leaf.index;
-
-    if (index != length && length != static_traits::segment_max()) {
-      move_segment(pointer, length - 1, pointer, length);
-      assign_forward_segment(pointer, length - 1, index, 1);
-      assign_segment(pointer, index, std::move(value));
-      ++entry.segment.length;
-      increment_sizes(parent_pointer, parent_index);
-      return;
-    }
+    auto parent_index = entry.leaf.index();
 
     if (pointer == nullptr) {
-      auto alloc = allocate_segment();
+      auto capacity = root_grow(1);
+      auto alloc = allocate_root(capacity);
       get_root() = alloc;
+      root_capacity_ =
+          static_cast<typename static_traits::leaf_size_type>(capacity);
       get_size() = 1;
       get_height() = 1;
       construct_segment(alloc, 0, std::move(value));
       entry.segment.pointer = alloc;
-      entry.segment.length = 1;
+      entry.segment.length(1);
       return;
     }
 
-    if (length != static_traits::segment_max()) {
-      construct_segment(pointer, index, std::move(value));
-      ++entry.segment.length;
+    // The root segment grows into a full block before it splits.
+    if (parent_pointer == nullptr && length == root_capacity_ &&
+        length != segment_max()) {
+      reallocate_root(root_grow(length + 1));
+      pointer = static_traits::cast_segment(get_root());
+      entry.segment.pointer = pointer;
+    }
+
+    if (length != segment_max()) {
+      // The root segment stays at the front of its block.
+      auto start = insert_room_segment(
+          pointer, segment_offset(parent_pointer, parent_index), length, index,
+          value, parent_pointer != nullptr);
+      if (start != pointer) {
+        segment_start(parent_pointer, parent_index, start);
+        entry.segment.pointer = start;
+      }
+      entry.segment.length(length + 1);
       increment_sizes(parent_pointer, parent_index);
       return;
     }
 
-    auto alloc = allocate_segment();
+    if (static_traits::redistribute() && parent_pointer != nullptr) {
+      if (insert_shift_segment(entry, value)) return;
+      // Splitting into thirds would leave partly filled segments behind a
+      // run of insertions at one edge.
+      auto edge =
+          static_traits::edge_split() && (index == 0 || index == length);
+      if (segment_max() >= 3 && !edge) {
+        insert_split_segment(entry, value);
+        return;
+      }
+    }
+
+    auto alloc = allocate_segment(segment_base(
+        pointer, segment_offset(parent_pointer, parent_index)));
     auto leaf_alloc = alloc_nodes_single(parent_pointer, alloc);
 
-    constexpr auto sum = static_traits::segment_max() + 1;
-    constexpr auto pointer_length = sum / 2;
-    constexpr auto alloc_length = sum - pointer_length;
+    auto sum = segment_max() + 1;
+    auto pointer_length =
+        split_length(segment_max(), segment_min(), 0, index);
+    auto alloc_length = sum - pointer_length;
 
+    auto start = pointer;
     if (index < pointer_length) {
       auto left_index = pointer_length - 1;
-      move_segment(pointer, left_index, alloc, 0);
-      construct_range_segment(pointer, left_index + 1, alloc, 1,
-                              alloc_length - 1);
-      assign_forward_segment(pointer, left_index, index, 1);
-      assign_segment(pointer, index, std::move(value));
-
-      entry.segment.length = pointer_length;
+      construct_range_segment(pointer, left_index, alloc, 0, alloc_length);
+      insert_tail_segment(pointer, left_index, index, value,
+                          relocate_bitwise{});
+
+      // Leaves the room of a block split at its front in front of it, so
+      // further insertions there don't move the elements after them.
+      if (static_traits::floating_segments() && static_traits::edge_split() &&
+          index == 0)
+        start = slide_forward_segment(pointer, pointer_length,
+                                      segment_max() -
+                                          pointer_length);
+      entry.segment.length(pointer_length);
     } else {
       auto new_index = index - pointer_length;
       auto move_length = length - index;
@@ -1661,22 +3504,28 @@ class seq {
       construct_range_segment(pointer, index, alloc, new_index + 1,
                               move_length);
       construct_segment(alloc, new_index, std::move(value));
-      entry.segment.length = alloc_length;
+      entry.segment.length(alloc_length);
       entry.segment.pointer = alloc;
-      entry.segment.index = new_index;
-      ++entry.leaf.index;
+      entry.segment.index(new_index);
+      entry.leaf.index(entry.leaf.index() + 1);
     }
 
     insert_single_leaf(entry, pointer, parent_pointer, parent_index + 1,
                        leaf_alloc, alloc, alloc_length);
+    if (start != pointer) {
+      segment_start(entry.leaf.pointer, entry.leaf.index(), start);
+      entry.segment.pointer = start;
+    }
   }
 
   void insert_single_leaf(iterator_entry& entry, element_pointer base,
-                          node_pointer pointer, size_type index,
-                          node_pointer alloc, element_pointer child_pointer,
+                          leaf_pointer pointer, size_type index,
+                          leaf_pointer alloc, element_pointer child_pointer,
                           size_type child_size) {
     if (pointer == nullptr) {
       alloc->parent_pointer = nullptr;
+      alloc->prev_pointer = nullptr;
+      alloc->next_pointer = nullptr;
       alloc->parent_index(0);
       alloc->length(2);
       construct_leaf(alloc, 0, get_size() - child_size + 1, base);
@@ -1691,22 +3540,22 @@ class seq {
     auto length = pointer->length();
     pointer->sizes[index - 1] -= child_size - 1;
 
-    if (length != static_traits::base_max()) {
-      if (index != length) {
-        move_leaf(pointer, length - 1, pointer, length);
-        assign_forward_leaf(pointer, length - 1, index, 1);
-        assign_leaf(pointer, index, child_size, child_pointer);
-      } else
-        construct_leaf(pointer, index, child_size, child_pointer);
-      pointer->length(length + 1);
+    if (length != static_traits::leaf_max()) {
+      insert_room_leaf(pointer, index, child_size, child_pointer);
       increment_sizes(pointer->parent_pointer, pointer->parent_index());
       return;
     }
 
+    if (alloc == nullptr) {
+      insert_shift_leaf(entry, pointer, index, child_pointer, child_size);
+      return;
+    }
+
     auto next_alloc = alloc->parent_pointer;
-    constexpr auto sum = static_traits::base_max() + 1;
-    constexpr auto pointer_length = sum / 2;
-    constexpr auto alloc_length = sum - pointer_length;
+    constexpr auto sum = static_traits::leaf_max() + 1;
+    auto pointer_length = split_length(static_traits::leaf_max(),
+                                       static_traits::leaf_min(), 1, index);
+    auto alloc_length = sum - pointer_length;
 
     size_type alloc_size = 0;
     if (index < pointer_length) {
@@ -1728,10 +3577,11 @@ class seq {
 
     pointer->length(pointer_length);
     alloc->length(alloc_length);
+    link_leaf(pointer, alloc);
 
-    if (entry.leaf.index >= pointer_length) {
+    if (entry.leaf.index() >= pointer_length) {
       entry.leaf.pointer = alloc;
-      entry.leaf.index -= pointer_length;
+      entry.leaf.index(entry.leaf.index() - pointer_length);
     }
 
     insert_single_branch(pointer, pointer->parent_pointer,
@@ -1739,9 +3589,9 @@ class seq {
                          alloc_size);
   }
 
-  void insert_single_branch(node_pointer base, node_pointer pointer,
+  void insert_single_branch(void_pointer base, node_pointer pointer,
                             size_type index, node_pointer alloc,
-                            node_pointer child_pointer, size_type child_size) {
+                            void_pointer child_pointer, size_type child_size) {
     while (true) {
       if (pointer == nullptr) {
         alloc->parent_pointer = nullptr;
@@ -1759,21 +3609,21 @@ class seq {
       pointer->sizes[index - 1] -= child_size - 1;
 
       if (length != static_traits::base_max()) {
-        if (index != length) {
-          move_branch(pointer, length - 1, pointer, length);
-          assign_forward_branch(pointer, length - 1, index, 1);
-          assign_branch(pointer, index, child_size, child_pointer);
-        } else
-          construct_branch(pointer, index, child_size, child_pointer);
-        pointer->length(length + 1);
+        insert_room_branch(pointer, index, child_size, child_pointer);
         increment_sizes(pointer->parent_pointer, pointer->parent_index());
         return;
       }
 
+      if (alloc == nullptr) {
+        insert_shift_branch(pointer, index, child_pointer, child_size);
+        return;
+      }
+
       auto next_alloc = alloc->parent_pointer;
       constexpr auto sum = static_traits::base_max() + 1;
-      constexpr auto pointer_length = sum / 2;
-      constexpr auto alloc_length = sum - pointer_length;
+      auto pointer_length = split_length(static_traits::base_max(),
+                                         static_traits::base_min(), 1, index);
+      auto alloc_length = sum - pointer_length;
 
       size_type alloc_size = 0;
       if (index < pointer_length) {
@@ -1813,33 +3663,39 @@ class seq {
 
   void erase_single_segment(iterator_entry& entry) {
     auto pointer = entry.segment.pointer;
-    auto index = entry.segment.index;
-    auto length = entry.segment.length;
+    auto index = entry.segment.index();
+    auto length = entry.segment.length();
     auto parent_pointer = entry.leaf.pointer;
-    auto parent_index = entry.leaf.index;
+    auto parent_index = entry.leaf.index();
 
     if (length == 1 &&
-        (static_traits::segment_min() != 1 || parent_pointer == nullptr)) {
+        (segment_min() != 1 || parent_pointer == nullptr)) {
       destroy_segment(pointer, 0);
-      deallocate_segment(pointer);
+      deallocate_root(pointer, root_capacity_);
       get_root() = nullptr;
       get_size() = 0;
       get_height() = 0;
       entry.segment.pointer = nullptr;
-      entry.segment.index = 0;
-      entry.segment.length = 0;
+      entry.segment.index(0);
+      entry.segment.length(0);
       return;
     }
 
-    if (length-- != static_traits::segment_min() || parent_pointer == nullptr) {
-      assign_backward_segment(pointer, length, index, 1);
-      destroy_segment(pointer, length);
-      entry.segment.length = length;
+    // The root segment stays at the front of its block.
+    auto floating = parent_pointer != nullptr;
+    if (length-- != segment_min() || parent_pointer == nullptr) {
+      auto start = erase_room_segment(pointer, length, index, floating);
+      if (start != pointer) {
+        segment_start(parent_pointer, parent_index, start);
+        entry.segment.pointer = start;
+      }
+      entry.segment.length(length);
       decrement_sizes(parent_pointer, parent_index);
       return;
     }
 
-    constexpr auto merge_size = static_traits::segment_min() * 2 - 1;
+    auto max = segment_max();
+    auto merge_size = segment_min() * 2 - 1;
     auto pointers = &parent_pointer->pointers[0];
     auto sizes = &parent_pointer->sizes[0];
 
@@ -1849,29 +3705,43 @@ class seq {
       auto prev_pointer = static_traits::cast_segment(pointers[prev_index]);
       auto prev_length = sizes[prev_index];
 
-      if (prev_length != static_traits::segment_min()) {
-        --prev_length;
-        assign_forward_segment(pointer, index, 0, 1);
-        move_assign_segment(prev_pointer, prev_length, pointer, 0);
-        destroy_segment(prev_pointer, prev_length);
-        sizes[prev_index] = prev_length;
-        ++entry.segment.index;
+      if (prev_length != segment_min()) {
+        auto count = (prev_length - length) / 2;
+        auto start = erase_room_segment(pointer, length, index, floating);
+        segment_start(parent_pointer, parent_index, start);
+        move_tail_segment(prev_pointer, prev_length, start,
+                          parent_pointer->offset(parent_index), length, count);
+        segment_start(parent_pointer, parent_index, start);
+        sizes[prev_index] = static_cast<typename static_traits::leaf_size_type>(
+            prev_length - count);
+        sizes[parent_index] =
+            static_cast<typename static_traits::leaf_size_type>(length + count);
+        entry.segment.pointer = start;
+        entry.segment.index(entry.segment.index() + count);
+        entry.segment.length(length + count);
         decrement_sizes(parent_pointer->parent_pointer,
                         parent_pointer->parent_index());
         return;
       }
 
+      auto room = max - parent_pointer->offset(prev_index) - prev_length;
+      if (room < length) {
+        prev_pointer =
+            slide_backward_segment(prev_pointer, prev_length, length - room);
+        segment_start(parent_pointer, prev_index, prev_pointer);
+      }
       construct_range_segment(pointer, 0, prev_pointer, prev_length, index);
       construct_range_segment(pointer, index + 1, prev_pointer,
                               prev_length + index, length - index);
       destroy_segment(pointer, index);
-      deallocate_segment(pointer);
+      deallocate_segment(
+          segment_base(pointer, parent_pointer->offset(parent_index)));
       sizes[prev_index] = merge_size;
       erase_index = parent_index;
       entry.segment.pointer = prev_pointer;
-      entry.segment.length = merge_size;
-      entry.segment.index += static_traits::segment_min();
-      --entry.leaf.index;
+      entry.segment.length(merge_size);
+      entry.segment.index(entry.segment.index() + segment_min());
+      entry.leaf.index(entry.leaf.index() - 1);
     }
 
     else {
@@ -1879,56 +3749,78 @@ class seq {
       auto next_pointer = static_traits::cast_segment(pointers[next_index]);
       auto next_length = sizes[next_index];
 
-      if (next_length != static_traits::segment_min()) {
-        --next_length;
-        assign_backward_segment(pointer, length, index, 1);
-        move_assign_segment(next_pointer, 0, pointer, length);
-        assign_backward_segment(next_pointer, next_length, 0, 1);
-        destroy_segment(next_pointer, next_length);
-        sizes[next_index] = next_length;
+      if (next_length != segment_min()) {
+        auto count = (next_length - length) / 2;
+        auto start = erase_room_segment(pointer, length, index, floating);
+        segment_start(parent_pointer, parent_index, start);
+        move_head_segment(next_pointer, next_length, start,
+                          parent_pointer->offset(parent_index), length, count);
+        segment_start(parent_pointer, parent_index, start);
+        segment_start(parent_pointer, next_index, next_pointer);
+        sizes[next_index] = static_cast<typename static_traits::leaf_size_type>(
+            next_length - count);
+        sizes[parent_index] =
+            static_cast<typename static_traits::leaf_size_type>(length + count);
+        entry.segment.pointer = start;
+        entry.segment.length(length + count);
         decrement_sizes(parent_pointer->parent_pointer,
                         parent_pointer->parent_index());
         return;
       }
 
-      assign_backward_segment(pointer, length, index, 1);
-      move_assign_segment(next_pointer, 0, pointer, length);
-      destroy_segment(next_pointer, 0);
-      construct_range_segment(next_pointer, 1, pointer, length + 1,
-                              next_length - 1);
-      deallocate_segment(next_pointer);
+      // Closing the gap towards the back leaves the most room for next.
+      auto start = erase_room_segment(pointer, length, index, false);
+      auto room = max - parent_pointer->offset(parent_index) - length;
+      if (room < next_length) {
+        start = slide_backward_segment(start, length, next_length - room);
+        segment_start(parent_pointer, parent_index, start);
+      }
+      construct_range_segment(next_pointer, 0, start, length, next_length);
+      deallocate_segment(
+          segment_base(next_pointer, parent_pointer->offset(next_index)));
 
       sizes[parent_index] = merge_size;
       erase_index = next_index;
-      entry.segment.length = merge_size;
+      entry.segment.pointer = start;
+      entry.segment.length(merge_size);
     }
 
+    auto offset = parent_pointer->offset(entry.leaf.index());
     erase_single_leaf(entry.leaf, parent_pointer, erase_index);
+
+    // A lone segment is the root, which starts at the front of its block.
+    if (get_height() == 1 && offset != 0) {
+      auto start =
+          slide_backward_segment(entry.segment.pointer, merge_size, offset);
+      get_root() = start;
+      entry.segment.pointer = start;
+    }
   }
 
-  void erase_single_leaf(leaf_entry& entry, node_pointer pointer,
+  void erase_single_leaf(leaf_entry& entry, leaf_pointer pointer,
                          size_type index) {
     auto parent_pointer = pointer->parent_pointer;
     auto parent_index = pointer->parent_index();
     auto length = pointer->length();
 
     if (length == 2 &&
-        (static_traits::base_min() != 2 || parent_pointer == nullptr)) {
+        (static_traits::leaf_min() != 2 || parent_pointer == nullptr)) {
       auto other = pointer->pointers[index ^ 1];
-      destroy_node(pointer, 0);
-      destroy_node(pointer, 1);
-      deallocate_node(pointer);
+      destroy_leaf(pointer, 0);
+      destroy_leaf(pointer, 1);
+      deallocate_leaf(pointer);
       get_root() = other;
+      root_capacity_ = segment_max();
       --get_size();
       get_height() = 1;
       entry.pointer = nullptr;
-      entry.index = 0;
+      entry.index(0);
       return;
     }
 
-    if (length-- != static_traits::base_min() || parent_pointer == nullptr) {
+    if (length-- != static_traits::leaf_min() || parent_pointer == nullptr) {
       assign_backward_leaf(pointer, length, index, 1);
-      destroy_node(pointer, length);
+      destroy_leaf(pointer, length);
       pointer->length(length);
       decrement_sizes(parent_pointer, parent_index);
       return;
@@ -1940,18 +3832,18 @@ class seq {
     size_type erase_index;
     if (parent_index != 0) {
       auto prev_index = parent_index - 1;
-      auto prev_pointer = static_traits::cast_node(pointers[prev_index]);
+      auto prev_pointer = static_traits::cast_leaf(pointers[prev_index]);
       auto prev_length = prev_pointer->length();
 
-      if (prev_length != static_traits::base_min()) {
-        --prev_length;
-        assign_forward_leaf(pointer, index, 0, 1);
-        auto sz = move_assign_leaf(prev_pointer, prev_length, pointer, 0);
-        destroy_node(prev_pointer, prev_length);
+      if (prev_length != static_traits::leaf_min()) {
+        auto count = (prev_length - length) / 2;
+        assign_backward_leaf(pointer, length, index, 1);
+        destroy_leaf(pointer, length);
+        pointer->length(length);
+        auto sz = move_tail_leaf(prev_pointer, pointer, count);
         sizes[prev_index] -= sz;
         sizes[parent_index] += sz - 1;
-        prev_pointer->length(prev_length);
-        ++entry.index;
+        entry.index(entry.index() + count);
         decrement_sizes(parent_pointer->parent_pointer,
                         parent_pointer->parent_index());
         return;
@@ -1961,29 +3853,29 @@ class seq {
           construct_range_leaf(pointer, 0, prev_pointer, prev_length, index);
       sz += construct_range_leaf(pointer, index + 1, prev_pointer,
                                  prev_length + index, length - index);
-      destroy_node(pointer, index);
-      deallocate_node(pointer);
+      destroy_leaf(pointer, index);
+      unlink_leaf(pointer);
+      deallocate_leaf(pointer);
       prev_pointer->length(prev_length + length);
       sizes[prev_index] += sz;
       erase_index = parent_index;
       entry.pointer = prev_pointer;
-      entry.index += prev_length;
+      entry.index(entry.index() + prev_length);
     }
 
     else {
       auto next_index = parent_index + 1;
-      auto next_pointer = static_traits::cast_node(pointers[next_index]);
+      auto next_pointer = static_traits::cast_leaf(pointers[next_index]);
       auto next_length = next_pointer->length();
 
-      if (next_length != static_traits::base_min()) {
-        --next_length;
+      if (next_length != static_traits::leaf_min()) {
         assign_backward_leaf(pointer, length, index, 1);
-        auto sz = move_assign_leaf(next_pointer, 0, pointer, length);
-        assign_backward_leaf(next_pointer, next_length, 0, 1);
-        destroy_node(next_pointer, next_length);
+        destroy_leaf(pointer, length);
+        pointer->length(length);
+        auto count = (next_length - length) / 2;
+        auto sz = move_head_leaf(next_pointer, pointer, count);
         sizes[next_index] -= sz;
         sizes[parent_index] += sz - 1;
-        next_pointer->length(next_length);
         decrement_sizes(parent_pointer->parent_pointer,
                         parent_pointer->parent_index());
         return;
@@ -1991,10 +3883,11 @@ class seq {
 
       assign_backward_leaf(pointer, length, index, 1);
       auto sz = move_assign_leaf(next_pointer, 0, pointer, length);
-      destroy_node(next_pointer, 0);
+      destroy_leaf(next_pointer, 0);
       sz += construct_range_leaf(next_pointer, 1, pointer, length + 1,
                                  next_length - 1);
-      deallocate_node(next_pointer);
+      unlink_leaf(next_pointer);
+      deallocate_leaf(next_pointer);
       pointer->length(length + next_length);
       sizes[parent_index] += sz - 1;
       erase_index = next_index;
@@ -2011,7 +3904,7 @@ class seq {
 
       if (length == 2 &&
           (static_traits::base_min() != 2 || parent_pointer == nullptr)) {
-        auto other = static_traits::cast_node(pointer->pointers[index ^ 1]);
+        auto other = static_traits::cast_base(pointer->pointers[index ^ 1]);
         destroy_node(pointer, 0);
         destroy_node(pointer, 1);
         deallocate_node(pointer);
@@ -2041,13 +3934,13 @@ class seq {
         auto prev_length = prev_pointer->length();
 
         if (prev_length != static_traits::base_min()) {
-          --prev_length;
-          assign_forward_branch(pointer, index, 0, 1);
-          auto sz = move_assign_branch(prev_pointer, prev_length, pointer, 0);
-          destroy_node(prev_pointer, prev_length);
+          assign_backward_branch(pointer, length, index, 1);
+          destroy_node(pointer, length);
+          pointer->length(length);
+          auto count = (prev_length - length) / 2;
+          auto sz = move_tail_branch(prev_pointer, pointer, count);
           sizes[prev_index] -= sz;
           sizes[parent_index] += sz - 1;
-          prev_pointer->length(prev_length);
           decrement_sizes(parent_pointer->parent_pointer,
                           parent_pointer->parent_index());
           return;
@@ -2070,14 +3963,13 @@ class seq {
         auto next_length = next_pointer->length();
 
         if (next_length != static_traits::base_min()) {
-          --next_length;
           assign_backward_branch(pointer, length, index, 1);
-          auto sz = move_assign_branch(next_pointer, 0, pointer, length);
-          assign_backward_branch(next_pointer, next_length, 0, 1);
-          destroy_node(next_pointer, next_length);
+          destroy_node(pointer, length);
+          pointer->length(length);
+          auto count = (next_length - length) / 2;
+          auto sz = move_head_branch(next_pointer, pointer, count);
           sizes[next_index] -= sz;
           sizes[parent_index] += sz - 1;
-          next_pointer->length(next_length);
           decrement_sizes(parent_pointer->parent_pointer,
                           parent_pointer->parent_index());
           return;
@@ -2119,8 +4011,11 @@ class seq {
 
   void steal(seq& other) {
     get_root() = other.get_root();
+    root_capacity_ = other.root_capacity_;
+    segment_max_ = other.segment_max_;
     get_height() = other.get_height();
     get_size() = other.get_size();
+    get_segment_index().swap(other.get_segment_index());
     other.get_root() = nullptr;
     other.get_height() = 0;
     other.get_size() = 0;
@@ -2158,7 +4053,7 @@ class seq {
 
   iterator_data erase_single(iterator_data it) {
     erase_single_iterator(it);
-    if (it.entry.segment.index == it.entry.segment.length)
+    if (it.entry.segment.index() == it.entry.segment.length())
       static_traits::move_next_leaf(it.entry);
     return it;
   }
@@ -2185,7 +4080,7 @@ class seq {
         return;
       }
 
-      first.entry.segment.pointer[first.entry.segment.index] = value;
+      first.entry.segment.pointer[first.entry.segment.index()] = value;
       static_traits::move_next_iterator(first);
       --count;
     }
@@ -2206,7 +4101,7 @@ class seq {
         return;
       }
 
-      first.entry.segment.pointer[first.entry.segment.index] = *source_first;
+      first.entry.segment.pointer[first.entry.segment.index()] = *source_first;
       static_traits::move_next_iterator(first);
       ++source_first;
     }
@@ -2234,7 +4129,10 @@ class seq {
 
   template <typename = void>
   void copy_assign_alloc(seq const& other, std::true_type) {
-    if (get_element_allocator() != other.get_element_allocator()) clear();
+    if (get_element_allocator() != other.get_element_allocator()) {
+      clear();
+      release_cache();
+    }
     get_element_allocator() = other.get_element_allocator();
     get_node_allocator() = other.get_node_allocator();
   }
@@ -2284,8 +4182,10 @@ class seq {
   template <typename = void>
   void move_assign(seq& other, std::true_type) {
     purge();
+    release_cache();
     move_assign_alloc(other);
     steal(other);
+    swap_cache(other);
   }
 
   void swap_allocator(seq& other) {
@@ -2304,6 +4204,36 @@ class seq {
 
   template <typename = void>
   void swap_allocator(seq&, std::false_type) noexcept {}
+
+  // Returns the index of the element at address, which must be an element of
+  // the sequence. Sums the sizes in front of the segment's slot and of each of
+  // its ancestors.
+  size_type find_address(value_type const* address) const noexcept {
+    if (get_height() == 1)
+      return static_cast<size_type>(
+          address - std::addressof(static_traits::cast_segment(get_root())[0]));
+
+    auto block = static_cast<char const*>(get_segment_index().find(address));
+    segment_parent parent;
+    std::memcpy(&parent, block - static_traits::parent_length() * sizeof(T),
+                sizeof(parent));
+
+    auto pointer = parent.parent_pointer;
+    size_type index = parent.parent_index;
+    auto pos = static_cast<size_type>(
+                   reinterpret_cast<char const*>(address) - block) /
+                   sizeof(T) -
+               pointer->offset(index);
+    for (size_type i = 0; i != index; ++i) pos += pointer->sizes[i];
+
+    index = pointer->parent_index();
+    for (auto node = pointer->parent_pointer; node != nullptr;
+         node = node->parent_pointer) {
+      for (size_type i = 0; i != index; ++i) pos += node->sizes[i];
+      index = node->parent_index();
+    }
+    return pos;
+  }
 #endif  // #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
 
  public:
@@ -2367,6 +4297,7 @@ class seq {
   seq(seq const& other)
       : seq{element_traits::select_on_container_copy_construction(
             other.get_element_allocator())} {
+    segment_max_ = other.segment_max_;
     emplace_range(find_end(), other.begin(), other.end());
   }
 
@@ -2376,6 +4307,7 @@ class seq {
   /// \par Complexity
   ///   NlogN, where N is other.size().
   seq(seq const& other, Allocator const& alloc) : seq{alloc} {
+    segment_max_ = other.segment_max_;
     emplace_range(find_end(), other.begin(), other.end());
   }
 
@@ -2387,11 +4319,16 @@ class seq {
   seq(seq&& other) noexcept(
       std::is_nothrow_move_constructible<allocator_type>::value)
       : root_{other.root_},
+        root_capacity_{other.root_capacity_},
+        segment_max_{other.segment_max_},
         size_pair_{std::move(other.size_pair_)},
         height_pair_{std::move(other.height_pair_)} {
+    other.get_segment_index().clear();
     other.get_root() = nullptr;
     other.get_height() = 0;
     other.get_size() = 0;
+    swap_cache(other);
+    cache_.limit = other.cache_.limit;
   }
 
   /// \par Effects
@@ -2401,6 +4338,7 @@ class seq {
   ///   Constant if alloc compares equal to other's allocator. NlogN, where N is
   ///   other.size() otherwise.
   seq(seq&& other, Allocator const& alloc) : seq{alloc} {
+    segment_max_ = other.segment_max_;
     if (get_element_allocator() == other.get_element_allocator())
       steal(other);
     else
@@ -2424,7 +4362,10 @@ class seq {
   ///
   /// \par Complexity
   ///   Linear in size().
-  ~seq() { purge(); }
+  ~seq() {
+    purge();
+    release_cache();
+  }
 
   /// \par Effects
   ///   Copy assigns a sequence.
@@ -2993,6 +4934,51 @@ class seq {
   ///   Non-standard extension.
   size_type index_of(const_iterator pos) const noexcept { return pos.it_.pos; }
 
+  /// \par Returns
+  ///   An iterator to value, which must be an element of the sequence.
+  ///
+  /// \par Complexity
+  ///   Logarithmic in size().
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   No-throw.
+  ///
+  /// \par Note
+  ///   Non-standard extension. Requires BOOST_SEGMENTED_TREE_BACK_POINTERS to
+  ///   be defined to 1. The address of an element stays valid until an
+  ///   insertion or erasure in its segment moves it, so an index kept for it
+  ///   elsewhere can be refreshed with index_of(iterator_to(value)) after each
+  ///   edit.
+  iterator iterator_to(reference value) noexcept {
+    static_assert(static_traits::back_pointers(),
+                  "iterator_to requires BOOST_SEGMENTED_TREE_BACK_POINTERS");
+    return find_index(find_address(std::addressof(value)));
+  }
+
+  /// \par Returns
+  ///   A const_iterator to value, which must be an element of the sequence.
+  ///
+  /// \par Complexity
+  ///   Logarithmic in size().
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   No-throw.
+  ///
+  /// \par Note
+  ///   Non-standard extension. Requires BOOST_SEGMENTED_TREE_BACK_POINTERS to
+  ///   be defined to 1.
+  const_iterator iterator_to(const_reference value) const noexcept {
+    static_assert(static_traits::back_pointers(),
+                  "iterator_to requires BOOST_SEGMENTED_TREE_BACK_POINTERS");
+    return find_index(find_address(std::addressof(value)));
+  }
+
   /// \par Returns
   ///   True if the sequence is empty. False otherwise.
   ///
@@ -3050,6 +5036,203 @@ class seq {
     return (std::numeric_limits<size_type>::max)();
   }
 
+  /// \par Returns
+  ///   The number of freed segments, leaf nodes and index nodes of each kind
+  ///   that the sequence keeps for reuse instead of returning them to the
+  ///   allocator.
+  ///
+  /// \par Complexity
+  ///   Constant.
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   No-throw.
+  ///
+  /// \par Note
+  ///   Non-standard extension.
+  size_type cache_limit() const noexcept { return cache_.limit; }
+
+  /// \par Returns
+  ///   The number of elements a segment of the sequence holds at most.
+  ///
+  /// \par Complexity
+  ///   Constant.
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   No-throw.
+  ///
+  /// \par Note
+  ///   Non-standard extension.
+  size_type segment_limit() const noexcept { return segment_max(); }
+
+  /// \par Effects
+  ///   Sets the number of freed blocks of each kind kept for reuse, clamped to
+  ///   65535, and returns any cached blocks beyond it to the allocator. A limit
+  ///   of 0 disables the cache. Blocks provided by reserve() are kept
+  ///   regardless of the limit.
+  ///
+  /// \par Complexity
+  ///   Linear in the number of blocks returned.
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   No-throw.
+  ///
+  /// \par Note
+  ///   Non-standard extension.
+  void cache_limit(size_type limit) noexcept {
+    if (limit > 0xFFFF) limit = 0xFFFF;
+    cache_.limit = static_cast<std::uint16_t>(limit);
+    if (cache_.capacity == 0) trim_cache(limit);
+  }
+
+  /// \par Effects
+  ///   Sets the number of elements a segment holds at most, clamped between 2
+  ///   and the number that fit in segment_target bytes, and moves the elements
+  ///   into segments of that size. Smaller segments make insertions and
+  ///   erasures move fewer elements, larger ones make the tree shallower and
+  ///   iteration faster. Drops any reservation made by reserve() and returns
+  ///   all cached blocks to the allocator. Unless
+  ///   BOOST_SEGMENTED_TREE_RUNTIME_GEOMETRY is defined to 1 the limit stays
+  ///   at its maximum.
+  ///
+  /// \par Complexity
+  ///   Constant if the limit doesn't change. NlogN, where N is size(),
+  ///   otherwise.
+  ///
+  /// \par Iterator invalidation
+  ///   Invalidates all iterators if the limit changes.
+  ///
+  /// \par Exception safety
+  ///   Basic.
+  ///
+  /// \par Note
+  ///   Non-standard extension.
+  void segment_limit(size_type limit) {
+    size_type max = static_traits::segment_max();
+    if (!static_traits::runtime_geometry()) limit = max;
+    limit = (std::max)((std::min)(limit, max), (std::min)(max, size_type{2}));
+    if (limit == segment_max()) return;
+
+    seq other{get_element_allocator()};
+    other.segment_max_ =
+        static_cast<typename static_traits::leaf_size_type>(limit);
+    other.cache_.limit = cache_.limit;
+    other.emplace_range(other.find_end(), std::make_move_iterator(begin()),
+                        std::make_move_iterator(end()));
+    purge();
+    release_cache();
+    steal(other);
+    swap_cache(other);
+  }
+
+  /// \par Returns
+  ///   The count of elements the sequence can grow to without allocating, as
+  ///   requested by reserve(), or size() if that is larger.
+  ///
+  /// \par Complexity
+  ///   Constant.
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   No-throw.
+  size_type capacity() const noexcept {
+    return (std::max)(cache_.capacity, get_size());
+  }
+
+  /// \par Effects
+  ///   Allocates the segments and nodes needed to hold count elements in
+  ///   advance. Afterwards no insertion or removal allocates memory as long as
+  ///   size() stays within capacity(), and freed blocks are kept instead of
+  ///   being returned to the allocator. Does nothing if count is not greater
+  ///   than capacity().
+  ///
+  /// \par Complexity
+  ///   Linear in the number of blocks allocated and the number of nodes in the
+  ///   tree.
+  ///
+  /// \par Iterator invalidation
+  ///   Iterators are not invalidated.
+  ///
+  /// \par Exception safety
+  ///   Strong.
+  ///
+  /// \par Note
+  ///   Segments smaller than a pointer, or whose element type is less aligned
+  ///   than a pointer which is not trivially copyable, are not reserved.
+  void reserve(size_type count) {
+    if (count <= capacity()) return;
+
+    try {
+      reserve_blocks(count);
+    } catch (...) {
+      if (cache_.capacity == 0) trim_cache(cache_.limit);
+      throw;
+    }
+    cache_.capacity = count;
+  }
+
+  /// \par Effects
+  ///   Repacks the sequence so that segments and nodes are filled to fill, a
+  ///   fraction up to 1 that is raised to their minimum fill, and frees the
+  ///   blocks left over. Segments are
+  ///   only repacked if T is nothrow move constructible and assignable,
+  ///   otherwise just the nodes above them are.
+  ///
+  /// \par Complexity
+  ///   Linear in size().
+  ///
+  /// \par Iterator invalidation
+  ///   Invalidates all iterators.
+  ///
+  /// \par Exception safety
+  ///   Strong.
+  ///
+  /// \par Note
+  ///   Non-standard extension.
+  void compact(double fill = 1) {
+    if (!(fill > 0)) fill = 0;
+    if (fill > 1) fill = 1;
+
+    try {
+      compact_tree(fill);
+    } catch (...) {
+      if (cache_.capacity == 0) trim_cache(cache_.limit);
+      throw;
+    }
+    if (cache_.capacity == 0) trim_cache(cache_.limit);
+  }
+
+  /// \par Effects
+  ///   Repacks the sequence as compact(1) does, moves a lone segment into the
+  ///   smallest block it would have grown to for its elements, drops any
+  ///   reservation made by reserve() and returns all cached blocks to the
+  ///   allocator.
+  ///
+  /// \par Complexity
+  ///   Linear in size().
+  ///
+  /// \par Iterator invalidation
+  ///   Invalidates all iterators.
+  ///
+  /// \par Exception safety
+  ///   Strong.
+  void shrink_to_fit() {
+    compact(1);
+    if (get_height() == 1 && root_fit(get_size()) != root_capacity_)
+      reallocate_root(root_fit(get_size()));
+    release_cache();
+  }
+
   /// \par Effects
   ///   Removes all elements from the sequence.
   ///
@@ -3381,8 +5564,12 @@ class seq {
       detail::is_nothrow_swappable<allocator_type>::value) {
     using std::swap;
     swap(get_root(), other.get_root());
+    swap(root_capacity_, other.root_capacity_);
+    swap(segment_max_, other.segment_max_);
     swap(get_height(), other.get_height());
     swap(get_size(), other.get_size());
+    get_segment_index().swap(other.get_segment_index());
+    swap_cache(other);
     swap_allocator(other);
   }
 
@@ -10,7 +10,8 @@
 namespace boost {
 namespace segmented_tree {
 template <typename T, typename Allocator = std::allocator<T>,
-          std::size_t segment_target = 1024, std::size_t base_target = 768>
+          std::size_t segment_target = 1024, std::size_t base_target = 768,
+          std::size_t leaf_target = base_target>
 class seq;
 }
 }
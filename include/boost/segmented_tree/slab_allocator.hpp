@@ -0,0 +1,303 @@
+// (C) Copyright Chris Clearwater 2014-2015. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy
+// at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BOOST_SEGMENTED_TREE_SLAB_ALLOCATOR
+#define BOOST_SEGMENTED_TREE_SLAB_ALLOCATOR
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace boost {
+namespace segmented_tree {
+
+/// A memory arena that places blocks allocated with a hint next to the
+/// hinted block.
+///
+/// Memory is divided into slabs of slab_size bytes, each starting on a
+/// multiple of its size, so the slab of any block is found by masking its
+/// address. A request with a hint is served from the slab of the hinted block
+/// while that slab has room, and other requests from the slab filled last.
+/// seq passes the block a new one will sit next to in the tree: the leaf being
+/// split for a new leaf, and the segment being split for a new segment. A leaf
+/// and the segments filled in after it then share a slab, and so do sibling
+/// segments split from them, which keeps a descent from a leaf to its segments
+/// and a walk across sibling segments within a few adjacent pages.
+///
+/// Freed blocks are reused by later requests of the same size in the same
+/// slab. A slab whose blocks are all freed is reused for any request. Blocks
+/// larger than a slab get an allocation of their own. Memory is returned to
+/// the system when the arena is destroyed.
+class slab_arena {
+ private:
+  static constexpr std::size_t alignment = alignof(std::max_align_t);
+  static constexpr std::size_t classes = 8;
+  static constexpr std::size_t chunk_slabs = 16;
+
+  struct slab {
+    slab* next;
+    // The allocation a block larger than a slab came from, or nullptr.
+    void* large;
+    std::size_t cursor;
+    std::size_t live;
+    std::array<std::size_t, classes> sizes;
+    std::array<void*, classes> heads;
+  };
+
+  static constexpr std::size_t header_size() {
+    return (sizeof(slab) + alignment - 1) / alignment * alignment;
+  }
+
+  static std::size_t round_up(std::size_t bytes) {
+    if (bytes == 0) return alignment;
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+  static std::size_t round_up_slab(std::size_t bytes) {
+    std::size_t size = 1;
+    while (size < bytes || size < 4 * header_size()) size *= 2;
+    return size;
+  }
+
+  static void*& next_of(void* block) { return *static_cast<void**>(block); }
+
+  std::mutex mutex_;
+  std::vector<void*> chunks_;
+  char* fresh_{nullptr};
+  char* fresh_end_{nullptr};
+  slab* empty_{nullptr};
+  slab* current_{nullptr};
+  std::size_t slab_size_;
+
+  slab* slab_of(void const* block) const noexcept {
+    return reinterpret_cast<slab*>(reinterpret_cast<std::uintptr_t>(block) &
+                                   ~(slab_size_ - 1));
+  }
+
+  static slab* aligned_slab(void* raw, std::size_t size) {
+    auto address = reinterpret_cast<std::uintptr_t>(raw);
+    return reinterpret_cast<slab*>((address + size - 1) & ~(size - 1));
+  }
+
+  static void reset(slab* pointer) noexcept {
+    pointer->next = nullptr;
+    pointer->large = nullptr;
+    pointer->cursor = header_size();
+    pointer->live = 0;
+    pointer->sizes.fill(0);
+    pointer->heads.fill(nullptr);
+  }
+
+  // Returns the free list for bytes in pointer, or nullptr if the size class
+  // table is full. Blocks of such sizes are reclaimed when the slab empties.
+  static void** free_list(slab* pointer, std::size_t bytes) {
+    for (std::size_t i = 0; i != classes; ++i) {
+      if (pointer->sizes[i] == bytes) return &pointer->heads[i];
+      if (pointer->sizes[i] == 0) {
+        pointer->sizes[i] = bytes;
+        return &pointer->heads[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // Returns a block of bytes from pointer, or nullptr if it has no room.
+  void* allocate_from(slab* pointer, std::size_t bytes) {
+    auto list = free_list(pointer, bytes);
+    void* block = nullptr;
+    if (list != nullptr && *list != nullptr) {
+      block = *list;
+      *list = next_of(block);
+    } else if (slab_size_ - pointer->cursor >= bytes) {
+      block = reinterpret_cast<char*>(pointer) + pointer->cursor;
+      pointer->cursor += bytes;
+    } else {
+      return nullptr;
+    }
+    ++pointer->live;
+    return block;
+  }
+
+  slab* allocate_slab() {
+    if (empty_ != nullptr) {
+      auto pointer = empty_;
+      empty_ = pointer->next;
+      reset(pointer);
+      return pointer;
+    }
+
+    if (fresh_ == fresh_end_) {
+      // One slab more than needed leaves room to align the first.
+      chunks_.reserve(chunks_.size() + 1);
+      auto raw = ::operator new((chunk_slabs + 1) * slab_size_);
+      chunks_.push_back(raw);
+      fresh_ = reinterpret_cast<char*>(aligned_slab(raw, slab_size_));
+      fresh_end_ = fresh_ + chunk_slabs * slab_size_;
+    }
+
+    auto pointer = reinterpret_cast<slab*>(fresh_);
+    fresh_ += slab_size_;
+    reset(pointer);
+    return pointer;
+  }
+
+  void* allocate_large(std::size_t bytes) {
+    if (bytes > static_cast<std::size_t>(-1) - header_size() - slab_size_)
+      throw std::bad_alloc();
+    auto raw = ::operator new(header_size() + bytes + slab_size_);
+    auto pointer = aligned_slab(raw, slab_size_);
+    reset(pointer);
+    pointer->large = raw;
+    return reinterpret_cast<char*>(pointer) + header_size();
+  }
+
+ public:
+  /// \par Effects
+  ///   Constructs an empty arena with slabs of slab_size bytes, rounded up to
+  ///   a power of two. Slabs are carved 16 at a time from the global operator
+  ///   new.
+  explicit slab_arena(std::size_t slab_size = std::size_t{1} << 16)
+      : slab_size_{round_up_slab(slab_size)} {}
+
+  slab_arena(slab_arena const&) = delete;
+  slab_arena& operator=(slab_arena const&) = delete;
+
+  /// \par Effects
+  ///   Releases all memory owned by the arena.
+  ///
+  /// \par Note
+  ///   Blocks larger than a slab still allocated are not released.
+  ~slab_arena() {
+    for (auto raw : chunks_) ::operator delete(raw);
+  }
+
+  /// \par Returns
+  ///   A block of at least bytes bytes aligned for any fundamental type, in
+  ///   the slab of hint if hint is a block of this arena and its slab has
+  ///   room.
+  ///
+  /// \par Throws
+  ///   std::bad_alloc if a new slab can't be allocated.
+  void* allocate(std::size_t bytes, void const* hint = nullptr) {
+    bytes = round_up(bytes);
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (bytes > slab_size_ - header_size()) return allocate_large(bytes);
+
+    if (hint != nullptr) {
+      auto pointer = slab_of(hint);
+      if (pointer->large == nullptr) {
+        auto block = allocate_from(pointer, bytes);
+        if (block != nullptr) return block;
+      }
+    }
+
+    if (current_ != nullptr) {
+      auto block = allocate_from(current_, bytes);
+      if (block != nullptr) return block;
+      if (current_->live == 0) {
+        current_->next = empty_;
+        empty_ = current_;
+      }
+      current_ = nullptr;
+    }
+
+    current_ = allocate_slab();
+    return allocate_from(current_, bytes);
+  }
+
+  /// \par Effects
+  ///   Returns a block obtained from allocate(bytes) to the arena.
+  void deallocate(void* block, std::size_t bytes) noexcept {
+    bytes = round_up(bytes);
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto pointer = slab_of(block);
+    if (pointer->large != nullptr) {
+      ::operator delete(pointer->large);
+      return;
+    }
+
+    auto list = free_list(pointer, bytes);
+    if (list != nullptr) {
+      next_of(block) = *list;
+      *list = block;
+    }
+
+    if (--pointer->live == 0 && pointer != current_) {
+      pointer->next = empty_;
+      empty_ = pointer;
+    }
+  }
+
+  /// \par Returns
+  ///   The size in bytes of the slabs blocks are carved from.
+  std::size_t slab_size() const noexcept { return slab_size_; }
+};
+
+/// An allocator drawing from a slab_arena, meant to be shared by many seq
+/// instances. Copies and rebinds refer to the same arena and compare equal.
+///
+/// \tparam T The type of the element to be allocated.
+template <typename T>
+class slab_allocator {
+ private:
+  template <typename>
+  friend class slab_allocator;
+  slab_arena* arena_;
+
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "slab_allocator cannot satisfy the alignment of T");
+
+ public:
+  /// The allocated type.
+  using value_type = T;
+
+  /// \par Effects
+  ///   Constructs an allocator drawing from a.
+  slab_allocator(slab_arena& a) noexcept : arena_{&a} {}
+
+  template <typename U>
+  slab_allocator(slab_allocator<U> const& other) noexcept
+      : arena_{other.arena_} {}
+
+  /// \par Returns
+  ///   A pointer to storage for n objects of type T.
+  T* allocate(std::size_t n) { return allocate(n, nullptr); }
+
+  /// \par Returns
+  ///   A pointer to storage for n objects of type T, next to hint if it was
+  ///   allocated from the same arena.
+  T* allocate(std::size_t n, void const* hint) {
+    if (n > static_cast<std::size_t>(-1) / sizeof(T)) throw std::bad_alloc();
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), hint));
+  }
+
+  /// \par Effects
+  ///   Returns the storage of n objects pointed to by p to the arena.
+  void deallocate(T* p, std::size_t n) noexcept {
+    arena_->deallocate(p, n * sizeof(T));
+  }
+
+  /// \par Returns
+  ///   The arena memory is drawn from.
+  slab_arena& resource() const noexcept { return *arena_; }
+};
+
+template <typename T, typename U>
+inline bool operator==(slab_allocator<T> const& a,
+                       slab_allocator<U> const& b) noexcept {
+  return &a.resource() == &b.resource();
+}
+
+template <typename T, typename U>
+inline bool operator!=(slab_allocator<T> const& a,
+                       slab_allocator<U> const& b) noexcept {
+  return !(a == b);
+}
+}
+}
+
+#endif  // #ifndef BOOST_SEGMENTED_TREE_SLAB_ALLOCATOR
@@ -0,0 +1,142 @@
+// (C) Copyright Chris Clearwater 2014-2015. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy
+// at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BOOST_SEGMENTED_TREE_TUNE
+#define BOOST_SEGMENTED_TREE_TUNE
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace boost {
+namespace segmented_tree {
+
+/// The operations a sequence is expected to see, for tune_segment_limit(). The
+/// counts of each kind of operation are relative weights.
+struct workload {
+  /// The typical number of elements in the sequence.
+  std::size_t size{100000};
+  /// Insertions at random positions.
+  std::size_t inserts{1};
+  /// Erasures at random positions.
+  std::size_t erases{1};
+  /// Reads of single elements at random positions.
+  std::size_t reads{1};
+  /// Reads of scan_length consecutive elements from a random position.
+  std::size_t scans{1};
+  /// The number of elements a scan reads.
+  std::size_t scan_length{100};
+};
+
+#ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+namespace detail {
+// Every candidate sees the same operations.
+class tune_random {
+ private:
+  std::uint64_t state_{0x853C49E6748FEA9BULL};
+
+ public:
+  std::size_t operator()(std::size_t bound) {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<std::size_t>((state_ >> 33) % bound);
+  }
+};
+
+template <typename T>
+unsigned char touch(T const& value) {
+  unsigned char byte;
+  std::memcpy(&byte, std::addressof(value), 1);
+  return byte;
+}
+
+// Returns the time in seconds the operations of mix took on sequence.
+template <typename Seq>
+double run_workload(Seq& sequence, workload const& mix,
+                    typename Seq::value_type const& value) {
+  using clock = std::chrono::steady_clock;
+  tune_random random;
+  auto total = mix.inserts + mix.erases + mix.reads + mix.scans;
+  unsigned char sink = 0;
+
+  auto start = clock::now();
+  for (std::size_t i = 0; i != mix.size; ++i) {
+    auto pick = random(total);
+    auto size = sequence.size();
+    if (pick < mix.inserts) {
+      sequence.insert(sequence.nth(random(size + 1)), value);
+    } else if (size == 0) {
+      continue;
+    } else if ((pick -= mix.inserts) < mix.erases) {
+      sequence.erase(sequence.nth(random(size)));
+    } else if ((pick -= mix.erases) < mix.reads) {
+      sink ^= touch(*sequence.nth(random(size)));
+    } else {
+      auto it = sequence.nth(random(size));
+      for (std::size_t j = 0; j != mix.scan_length && it != sequence.end();
+           ++j, ++it)
+        sink ^= touch(*it);
+    }
+  }
+  auto seconds =
+      std::chrono::duration<double>(clock::now() - start).count();
+
+  // Keeps the reads from being optimized away.
+  volatile unsigned char keep = sink;
+  (void)keep;
+  return seconds;
+}
+}
+#endif  // #ifndef BOOST_SEGMENTED_TREE_DOXYGEN_INVOKED
+
+/// \par Returns
+///   The segment limit that ran mix fastest on this machine, out of the
+///   largest limit Seq allows and its halves down to 2, for use with
+///   seq::segment_limit(). Each candidate runs mix.size operations of mix,
+///   twice, on a sequence of mix.size copies of value.
+///
+/// \par Complexity
+///   Linear in mix.size times the number of candidates, plus the cost of the
+///   operations.
+///
+/// \par Note
+///   Meant to run once at startup. Returns the largest limit if all weights
+///   are 0 or BOOST_SEGMENTED_TREE_RUNTIME_GEOMETRY is not defined to 1.
+template <typename Seq>
+typename Seq::size_type tune_segment_limit(
+    workload const& mix,
+    typename Seq::value_type const& value = typename Seq::value_type{}) {
+  using size_type = typename Seq::size_type;
+  auto max = Seq{}.segment_limit();
+  if (mix.inserts + mix.erases + mix.reads + mix.scans == 0) return max;
+
+  auto best = max;
+  double best_seconds = 0;
+  for (auto limit = max;; limit /= 2) {
+    Seq sequence;
+    sequence.segment_limit(limit);
+    if (sequence.segment_limit() != limit) break;
+
+    double seconds = 0;
+    for (int round = 0; round != 2; ++round) {
+      sequence.clear();
+      sequence.insert(sequence.end(), static_cast<size_type>(mix.size),
+                      value);
+      auto time = detail::run_workload(sequence, mix, value);
+      if (round == 0 || time < seconds) seconds = time;
+    }
+
+    if (limit == max || seconds < best_seconds) {
+      best = limit;
+      best_seconds = seconds;
+    }
+    if (limit <= 2) break;
+  }
+  return best;
+}
+}
+}
+
+#endif  // #ifndef BOOST_SEGMENTED_TREE_TUNE
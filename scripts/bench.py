@@ -12,8 +12,8 @@ output_dir = sys.argv[2]
 
 trials = 5
 
-containers = ["segmented_tree_seq", "btree_seq", "bpt_sequence", "avl_array",
-              "deque", "vector"]
+containers = ["segmented_tree_seq", "segmented_tree_seq_huge", "btree_seq",
+              "bpt_sequence", "avl_array", "deque", "vector"]
 
 single_8_labels = ["256", "7936", "246016", "7626496"]
 single_8_args = [(256, 2107779313, 15865477950454414828),
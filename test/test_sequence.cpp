@@ -1,6 +1,12 @@
 #define BOOST_TEST_MODULE test_sequence
 
 #include <boost/segmented_tree/seq.hpp>
+#include <boost/segmented_tree/aligned_allocator.hpp>
+#include <boost/segmented_tree/arena_allocator.hpp>
+#include <boost/segmented_tree/compact_allocator.hpp>
+#include <boost/segmented_tree/huge_page_allocator.hpp>
+#include <boost/segmented_tree/slab_allocator.hpp>
+#include <boost/segmented_tree/tune.hpp>
 #include <boost/test/unit_test.hpp>
 #include <exception>
 #include <limits>
@@ -46,6 +52,75 @@ inline bool operator!=(const tagged_allocator<T>& a,
   return !(a == b);
 }
 
+template <typename T>
+class counting_allocator {
+ public:
+  using value_type = T;
+  counting_allocator() = default;
+  template <class U>
+  counting_allocator(counting_allocator<U> const&) {}
+
+  T* allocate(std::size_t n) {
+    if (n <= std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+      if (auto ptr = std::malloc(n * sizeof(T))) {
+        ++allocations();
+        ++live();
+        bytes() += n * sizeof(T);
+        return static_cast<T*>(ptr);
+      }
+    }
+    throw std::bad_alloc();
+  }
+
+  void deallocate(T* ptr, std::size_t n) {
+    --live();
+    bytes() -= n * sizeof(T);
+    std::free(ptr);
+  }
+
+  static std::size_t& allocations() {
+    static std::size_t count = 0;
+    return count;
+  }
+
+  static std::size_t& live() {
+    static std::size_t count = 0;
+    return count;
+  }
+
+  static std::size_t& bytes() {
+    static std::size_t count = 0;
+    return count;
+  }
+};
+
+template <typename T, typename U>
+inline bool operator==(const counting_allocator<T>&,
+                       const counting_allocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const counting_allocator<T>& a,
+                       const counting_allocator<U>& b) {
+  return !(a == b);
+}
+
+// Customizes construct, so elements are moved one at a time even if they are
+// trivially copyable.
+template <typename T>
+class constructing_allocator : public counting_allocator<T> {
+ public:
+  constructing_allocator() = default;
+  template <class U>
+  constructing_allocator(constructing_allocator<U> const&) {}
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    new (p) U(std::forward<Args>(args)...);
+  }
+};
+
 template <typename A, typename B>
 void check_contents(A const& a, std::initializer_list<B> b) {
   BOOST_CHECK(a.size() == b.size());
@@ -323,11 +398,204 @@ BOOST_AUTO_TEST_CASE(test_height) {
   BOOST_CHECK(c2.height() == 1);
 }
 
+template <std::size_t base_target, std::size_t leaf_target>
+std::size_t test_node_targets() {
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  auto count = data.indexes.size();
+  boost::segmented_tree::seq<uint64_t, std::allocator<uint64_t>, TARGET_SIZE,
+                             base_target, leaf_target>
+      c1;
+  std::vector<uint64_t> contents;
+  for (std::size_t i = 0; i != count; ++i) {
+    auto index = static_cast<std::ptrdiff_t>(data.indexes[i]);
+    c1.insert(c1.nth(data.indexes[i]), data.ordered[i]);
+    contents.insert(contents.begin() + index, data.ordered[i]);
+  }
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin()));
+  auto height = c1.height();
+
+  for (std::size_t i = 0; i != count - 1; ++i) {
+    auto index = data.indexes[count - 1 - i] % contents.size();
+    c1.erase(c1.nth(index));
+    contents.erase(contents.begin() + static_cast<std::ptrdiff_t>(index));
+  }
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin()));
+  return height;
+}
+
+BOOST_AUTO_TEST_CASE(test_leaf_target) {
+  auto narrow_leaves = test_node_targets<768, 64>();
+  auto wide_leaves = test_node_targets<768, 4096>();
+  BOOST_CHECK(wide_leaves < narrow_leaves);
+  test_node_targets<64, 4096>();
+  test_node_targets<4096, 64>();
+}
+
 BOOST_AUTO_TEST_CASE(test_max_size) {
   seq<uint64_t> c1;
   BOOST_CHECK(c1.max_size() == std::numeric_limits<std::size_t>::max());
 }
 
+BOOST_AUTO_TEST_CASE(test_cache_limit) {
+  using alloc = counting_allocator<uint64_t>;
+  seq<uint64_t, alloc> c1;
+  BOOST_CHECK(c1.cache_limit() == BOOST_SEGMENTED_TREE_CACHE_LIMIT);
+
+  for (uint64_t i = 0; i != 1000; ++i) c1.push_back(i);
+  c1.clear();
+  auto allocations = alloc::allocations();
+  for (uint64_t i = 0; i != 2; ++i) c1.push_back(i);
+  BOOST_CHECK(alloc::allocations() == allocations);
+
+  c1.clear();
+  BOOST_CHECK(alloc::live() != 0);
+  c1.cache_limit(0);
+  BOOST_CHECK(c1.cache_limit() == 0);
+  BOOST_CHECK(alloc::live() == 0);
+}
+
+#if BOOST_SEGMENTED_TREE_BACK_POINTERS
+BOOST_AUTO_TEST_CASE(test_iterator_to) {
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  auto count = data.indexes.size();
+  auto found = [](seq<uint64_t> const& c) {
+    for (std::size_t i = 0; i != c.size(); ++i)
+      if (c.index_of(c.iterator_to(c[i])) != i) return false;
+    return true;
+  };
+
+  seq<uint64_t> c1{0, 1, 2};
+  BOOST_CHECK(c1.iterator_to(c1[1]) == c1.nth(1));
+  BOOST_CHECK(found(c1));
+  c1.clear();
+
+  for (std::size_t i = 0; i != count; ++i) {
+    c1.insert(c1.nth(data.indexes[i]), data.ordered[i]);
+    if (i % 1024 == 0) BOOST_CHECK(found(c1));
+  }
+  BOOST_CHECK(found(c1));
+  for (std::size_t i = 0; i != count / 2; ++i)
+    c1.erase(c1.nth(data.indexes[count - 1 - i] % c1.size()));
+  BOOST_CHECK(found(c1));
+
+  auto& element = c1[c1.size() / 2];
+  auto it = c1.iterator_to(element);
+  BOOST_CHECK(&*it == &element);
+  BOOST_CHECK(c1.index_of(it) == c1.size() / 2);
+
+  c1.compact(0.75);
+  BOOST_CHECK(found(c1));
+  c1.segment_limit(4);
+  BOOST_CHECK(found(c1));
+
+  seq<uint64_t> c2{c1};
+  BOOST_CHECK(found(c2));
+  seq<uint64_t> c3;
+  c3.swap(c2);
+  BOOST_CHECK(found(c3));
+  seq<uint64_t> c4{std::move(c3)};
+  BOOST_CHECK(found(c4));
+  c4.shrink_to_fit();
+  BOOST_CHECK(found(c4));
+  c4.erase(c4.nth(1), c4.end());
+  BOOST_CHECK(found(c4));
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(test_segment_limit) {
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  auto count = data.indexes.size();
+  seq<uint64_t> c1;
+  std::vector<uint64_t> contents;
+  auto equal = [&](seq<uint64_t> const& c) {
+    return c.size() == contents.size() &&
+           std::equal(c.begin(), c.end(), contents.begin()) &&
+           std::equal(c.rbegin(), c.rend(), contents.rbegin());
+  };
+
+  auto max = c1.segment_limit();
+  BOOST_CHECK(max >= 1);
+#if BOOST_SEGMENTED_TREE_RUNTIME_GEOMETRY
+  auto limit = max >= 4 ? std::size_t{4} : max;
+#else
+  auto limit = max;
+#endif
+  c1.segment_limit(4);
+  BOOST_CHECK(c1.segment_limit() == limit);
+  c1.segment_limit(0);
+  BOOST_CHECK(c1.segment_limit() == (std::min)(max, std::size_t{2}));
+  c1.segment_limit(max + 1);
+  BOOST_CHECK(c1.segment_limit() == max);
+
+  for (std::size_t i = 0; i != count; ++i) {
+    auto index = static_cast<std::ptrdiff_t>(data.indexes[i]);
+    c1.insert(c1.nth(data.indexes[i]), data.ordered[i]);
+    contents.insert(contents.begin() + index, data.ordered[i]);
+  }
+  c1.segment_limit(4);
+  BOOST_CHECK(c1.segment_limit() == limit);
+  BOOST_CHECK(equal(c1));
+
+  for (std::size_t i = 0; i != count / 2; ++i) {
+    auto index = data.indexes[count - 1 - i] % contents.size();
+    c1.erase(c1.nth(index));
+    contents.erase(contents.begin() + static_cast<std::ptrdiff_t>(index));
+  }
+  BOOST_CHECK(equal(c1));
+
+  seq<uint64_t> c2{c1};
+  BOOST_CHECK(c2.segment_limit() == limit);
+  BOOST_CHECK(equal(c2));
+  seq<uint64_t> c3;
+  c3.swap(c2);
+  BOOST_CHECK(c3.segment_limit() == limit);
+  BOOST_CHECK(c2.segment_limit() == max);
+  seq<uint64_t> c4{std::move(c3)};
+  BOOST_CHECK(c4.segment_limit() == limit);
+  c4.shrink_to_fit();
+  BOOST_CHECK(equal(c4));
+
+  c1.segment_limit(max);
+  BOOST_CHECK(c1.segment_limit() == max);
+  BOOST_CHECK(equal(c1));
+
+  boost::segmented_tree::workload mix;
+  mix.size = 1000;
+  auto tuned = boost::segmented_tree::tune_segment_limit<seq<uint64_t>>(mix);
+  BOOST_CHECK(tuned >= 1 && tuned <= max);
+}
+
+BOOST_AUTO_TEST_CASE(test_reserve) {
+  using alloc = counting_allocator<uint64_t>;
+  {
+    seq<uint64_t, alloc> c1;
+    c1.push_back(0);
+    c1.reserve(30000);
+    BOOST_CHECK(c1.capacity() == 30000);
+    c1.cache_limit(0);
+
+    auto allocations = alloc::allocations();
+    uint64_t state = 463092544;
+    for (int round = 0; round != 3; ++round) {
+      while (c1.size() != 30000) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        c1.insert(c1.nth((state >> 33) % (c1.size() + 1)), state);
+      }
+      while (c1.size() != 1000) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        c1.erase(c1.nth((state >> 33) % c1.size()));
+      }
+    }
+    c1.clear();
+    for (uint64_t i = 0; i != 30000; ++i) c1.push_front(i);
+    BOOST_CHECK(alloc::allocations() == allocations);
+
+    c1.reserve(100);
+    BOOST_CHECK(c1.capacity() == 30000);
+  }
+  BOOST_CHECK(alloc::live() == 0);
+}
+
 BOOST_AUTO_TEST_CASE(test_clear) {
   seq<uint64_t> c1{0, 1, 2, 3, 4};
   c1.clear();
@@ -710,11 +978,11 @@ void test_iterator(Container const& container, std::vector<T> const& data) {
               accumulate_backward_by(container, 10000));
 }
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 void test_single(std::size_t count, std::uint32_t seed,
                  std::uint64_t checksum) {
   auto data = make_insertion_data_single<T>(count, seed);
-  seq<T> container;
+  seq<T, Alloc> container;
   insert_single(container, data);
   std::vector<T> inserted{container.begin(), container.end()};
   BOOST_CHECK(checksum == make_checksum_unsigned(inserted));
@@ -731,11 +999,11 @@ BOOST_AUTO_TEST_CASE(test_random_single) {
   test_single<uint64_t>(953312ULL, 3109453262ULL, 10176667110359292238ULL);
 }
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 void test_range(std::size_t count, std::size_t size, std::uint32_t seed,
                 std::uint64_t checksum) {
   auto data = make_insertion_data_range<T>(count, size, seed);
-  seq<T> container;
+  seq<T, Alloc> container;
   insert_range(container, data);
   std::vector<T> inserted{container.begin(), container.end()};
   BOOST_CHECK(checksum == make_checksum_unsigned(inserted));
@@ -752,6 +1020,536 @@ BOOST_AUTO_TEST_CASE(test_random_range) {
   test_range<uint64_t>(29791ULL, 32ULL, 3727649439ULL, 10804193997107502541ULL);
 }
 
+BOOST_AUTO_TEST_CASE(test_random_compact) {
+  using alloc = boost::segmented_tree::compact_allocator<uint64_t>;
+  test_single<uint64_t, alloc>(992ULL, 463092544ULL, 12966777589746855639ULL);
+  test_single<uint64_t, alloc>(30752ULL, 430452927ULL, 751509891372566603ULL);
+  test_range<uint64_t, alloc>(31ULL, 30752ULL, 1082972474ULL,
+                              11846815057285548515ULL);
+  test_range<uint64_t, alloc>(961ULL, 992ULL, 5659033ULL,
+                              14482810490810820797ULL);
+}
+
+BOOST_AUTO_TEST_CASE(test_random_arena) {
+  using alloc = boost::segmented_tree::arena_allocator<uint64_t>;
+  boost::segmented_tree::arena arena{4096, 8};
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+
+  for (int i = 0; i != 2; ++i) {
+    seq<uint64_t, alloc> c1{alloc{arena}};
+    insert_single(c1, data);
+    seq<uint64_t, alloc> c2{c1};
+    BOOST_CHECK(c1.get_allocator() == c2.get_allocator());
+    std::vector<uint64_t> inserted{c2.begin(), c2.end()};
+    BOOST_CHECK(751509891372566603ULL == make_checksum_unsigned(inserted));
+    test_iterator(c2, inserted);
+    erase_single(c1, data);
+    BOOST_CHECK(c1.size() == std::size_t{1});
+    BOOST_CHECK(c1[0] == data.ordered[0]);
+  }
+
+  arena.release();
+  seq<uint64_t, alloc> c3{{0, 1, 2, 3, 4}, alloc{arena}};
+  check_contents(c3, {0, 1, 2, 3, 4});
+}
+
+BOOST_AUTO_TEST_CASE(test_random_huge_pages) {
+  using alloc = boost::segmented_tree::huge_page_allocator<uint64_t>;
+  test_single<uint64_t, alloc>(992ULL, 463092544ULL, 12966777589746855639ULL);
+  test_single<uint64_t, alloc>(30752ULL, 430452927ULL, 751509891372566603ULL);
+  test_range<uint64_t, alloc>(31ULL, 30752ULL, 1082972474ULL,
+                              11846815057285548515ULL);
+
+  boost::segmented_tree::arena arena{4096, 0, true};
+  BOOST_CHECK(arena.huge_pages());
+  BOOST_CHECK(arena.chunk_size() > 4096);
+  BOOST_CHECK(arena.chunk_size() < std::size_t{1} << 21);
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  using arena_alloc = boost::segmented_tree::arena_allocator<uint64_t>;
+  seq<uint64_t, arena_alloc> c1{arena_alloc{arena}};
+  insert_single(c1, data);
+  std::vector<uint64_t> inserted{c1.begin(), c1.end()};
+  BOOST_CHECK(751509891372566603ULL == make_checksum_unsigned(inserted));
+  erase_single(c1, data);
+  BOOST_CHECK(c1.size() == std::size_t{1});
+  BOOST_CHECK(c1[0] == data.ordered[0]);
+}
+
+BOOST_AUTO_TEST_CASE(test_random_slab) {
+  using alloc = boost::segmented_tree::slab_allocator<uint64_t>;
+  boost::segmented_tree::slab_arena arena{4096};
+  BOOST_CHECK(arena.slab_size() == 4096);
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+
+  for (int i = 0; i != 2; ++i) {
+    seq<uint64_t, alloc> c1{alloc{arena}};
+    insert_single(c1, data);
+    seq<uint64_t, alloc> c2{c1};
+    BOOST_CHECK(c1.get_allocator() == c2.get_allocator());
+    std::vector<uint64_t> inserted{c2.begin(), c2.end()};
+    BOOST_CHECK(751509891372566603ULL == make_checksum_unsigned(inserted));
+    test_iterator(c2, inserted);
+    erase_single(c1, data);
+    BOOST_CHECK(c1.size() == std::size_t{1});
+    BOOST_CHECK(c1[0] == data.ordered[0]);
+  }
+
+  // The filler leaves room for one more small block in the first slab, which
+  // only a hinted request gets once another slab is being filled.
+  boost::segmented_tree::slab_arena fresh{4096};
+  alloc a{fresh};
+  auto slab_of = [](uint64_t* p) {
+    return reinterpret_cast<std::uintptr_t>(p) & ~std::uintptr_t{4095};
+  };
+  auto first = a.allocate(2);
+  auto filler = a.allocate(480);
+  auto other = a.allocate(16);
+  auto near = a.allocate(2, first);
+  BOOST_CHECK(slab_of(filler) == slab_of(first));
+  BOOST_CHECK(slab_of(other) != slab_of(first));
+  BOOST_CHECK(slab_of(near) == slab_of(first));
+  auto large = a.allocate(512);
+  BOOST_CHECK(slab_of(a.allocate(2, large)) == slab_of(other));
+  a.deallocate(large, 512);
+  a.deallocate(near, 2);
+  a.deallocate(other, 16);
+  a.deallocate(filler, 480);
+  a.deallocate(first, 2);
+}
+
+template <typename T, typename Alloc = counting_allocator<T>>
+void test_compact(std::size_t count, std::uint32_t seed) {
+  using alloc = Alloc;
+  auto data = make_insertion_data_single<T>(count, seed);
+  {
+    seq<T, alloc> c1;
+    for (std::size_t i = 0; i != count; ++i)
+      c1.insert(c1.nth(data.indexes[i]), data.ordered[i]);
+    for (std::size_t i = 0; i != count / 2; ++i) c1.erase(c1.nth(i));
+    std::vector<T> remaining{c1.begin(), c1.end()};
+
+    c1.cache_limit(0);
+    auto live = alloc::live();
+    c1.compact(0.75);
+    BOOST_CHECK(alloc::live() <= live);
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), remaining.begin()));
+    test_iterator(c1, remaining);
+
+    live = alloc::live();
+    c1.shrink_to_fit();
+    BOOST_CHECK(alloc::live() <= live);
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), remaining.begin()));
+    test_iterator(c1, remaining);
+
+    live = alloc::live();
+    c1.shrink_to_fit();
+    BOOST_CHECK(alloc::live() == live);
+
+    auto middle = remaining.size() / 2;
+    std::vector<T> copy{remaining};
+    c1.insert(c1.nth(middle), copy.begin(), copy.end());
+    remaining.insert(remaining.begin() + static_cast<std::ptrdiff_t>(middle),
+                     copy.begin(), copy.end());
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), remaining.begin()));
+    c1.compact(0.5);
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), remaining.begin()));
+    test_iterator(c1, remaining);
+  }
+  BOOST_CHECK(alloc::live() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_shrink_to_fit) {
+  test_compact<uint64_t>(30752ULL, 430452927ULL);
+  test_compact<uint8_t>(30752ULL, 430452927ULL);
+  test_compact<uint64_t, constructing_allocator<uint64_t>>(30752ULL,
+                                                           430452927ULL);
+
+  seq<std::string> c1{"zero", "one", "two", "three", "four"};
+  std::vector<std::string> contents{c1.begin(), c1.end()};
+  for (int i = 0; i != 10; ++i) {
+    std::vector<std::string> copy{contents};
+    c1.insert(c1.nth(2), copy.begin(), copy.end());
+    contents.insert(contents.begin() + 2, copy.begin(), copy.end());
+  }
+  c1.erase(c1.nth(100), c1.nth(4000));
+  contents.erase(contents.begin() + 100, contents.begin() + 4000);
+  c1.shrink_to_fit();
+  BOOST_CHECK(c1.size() == contents.size());
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin()));
+  BOOST_CHECK(std::equal(c1.rbegin(), c1.rend(), contents.rbegin()));
+}
+
+BOOST_AUTO_TEST_CASE(test_redistribute) {
+  using alloc = counting_allocator<uint64_t>;
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  {
+    seq<uint64_t, alloc> c1;
+    c1.cache_limit(0);
+    for (std::size_t i = 0; i != data.ordered.size(); ++i)
+      c1.insert(c1.nth(data.indexes[i]), data.ordered[i]);
+    std::vector<uint64_t> inserted{c1.begin(), c1.end()};
+    BOOST_CHECK(751509891372566603ULL == make_checksum_unsigned(inserted));
+    test_iterator(c1, inserted);
+
+    // Splitting in half alone leaves random insertions about 70% full.
+    auto live = alloc::live();
+    c1.shrink_to_fit();
+    BOOST_CHECK(live * 4 <= alloc::live() * 5);
+  }
+  BOOST_CHECK(alloc::live() == 0);
+}
+
+template <typename Push>
+void test_edge_split(Push push) {
+  using alloc = counting_allocator<uint64_t>;
+  {
+    seq<uint64_t, alloc> c1;
+    c1.cache_limit(0);
+    std::vector<uint64_t> pushed;
+    for (uint64_t i = 0; i != 30752; ++i) push(c1, pushed, i);
+    BOOST_CHECK(c1.size() == pushed.size());
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), pushed.begin()));
+
+    // Blocks behind the edge are left full, so there is little to pack.
+    auto live = alloc::live();
+    c1.shrink_to_fit();
+    BOOST_CHECK(live * 50 <= alloc::live() * 51);
+  }
+  BOOST_CHECK(alloc::live() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_split_edge) {
+  using container = seq<uint64_t, counting_allocator<uint64_t>>;
+  test_edge_split([](container& c, std::vector<uint64_t>& v, uint64_t i) {
+    c.push_back(i);
+    v.push_back(i);
+  });
+  test_edge_split([](container& c, std::vector<uint64_t>& v, uint64_t i) {
+    c.push_front(i);
+    v.insert(v.begin(), i);
+  });
+}
+
+BOOST_AUTO_TEST_CASE(test_erase_rebalance) {
+  using alloc = counting_allocator<uint64_t>;
+  {
+    seq<uint64_t, alloc> c1;
+    std::vector<uint64_t> contents;
+    for (uint64_t i = 0; i != 30752; ++i) {
+      c1.push_back(i);
+      contents.push_back(i);
+    }
+    c1.compact(0);
+    c1.cache_limit(0);
+
+    // Every block is at its minimum, so the first erase merges. Later pairs
+    // must not split and merge again, but segments of one element are
+    // allocated by every insertion.
+    auto middle = contents.size() / 2;
+    auto allocations = alloc::allocations();
+    c1.erase(c1.nth(middle));
+    c1.insert(c1.nth(middle), 0);
+    contents[middle] = 0;
+    auto per_pair = alloc::allocations() - allocations;
+    for (uint64_t i = 1; i != 1000; ++i) {
+      c1.erase(c1.nth(middle));
+      c1.insert(c1.nth(middle), i);
+      contents[middle] = i;
+    }
+    BOOST_CHECK(alloc::allocations() - allocations <= 1000 * per_pair + 1);
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin()));
+
+    for (std::size_t i = 0; i != 10000; ++i) c1.pop_front();
+    BOOST_CHECK(c1.size() == contents.size() - 10000);
+    BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin() + 10000));
+    BOOST_CHECK(std::equal(c1.rbegin(), c1.rend(), contents.rbegin()));
+  }
+  BOOST_CHECK(alloc::live() == 0);
+}
+
+// Counts how often elements are moved.
+struct counted_move {
+  static std::size_t moves;
+  uint64_t value;
+
+  counted_move(uint64_t v = 0) : value{v} {}
+  counted_move(counted_move const&) = default;
+  counted_move(counted_move&& other) noexcept : value{other.value} { ++moves; }
+  counted_move& operator=(counted_move const&) = default;
+  counted_move& operator=(counted_move&& other) noexcept {
+    value = other.value;
+    ++moves;
+    return *this;
+  }
+
+  bool operator==(counted_move const& other) const {
+    return value == other.value;
+  }
+};
+
+std::size_t counted_move::moves = 0;
+
+BOOST_AUTO_TEST_CASE(test_floating_segments) {
+  seq<counted_move> c1;
+  std::vector<uint64_t> contents;
+  for (uint64_t i = 0; i != 30752; ++i) {
+    c1.push_back(i);
+    contents.push_back(i);
+  }
+
+  // Erasing at the front of a segment leaves room there, so taking turns
+  // with insertions at the same spot moves a bounded number of elements.
+  counted_move::moves = 0;
+  for (uint64_t i = 0; i != 1000; ++i) {
+    c1.pop_front();
+    c1.push_front(i);
+    contents.front() = i;
+  }
+  BOOST_CHECK(counted_move::moves <= 8 * 1000);
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin(),
+                         [](counted_move const& a, uint64_t b) {
+                           return a.value == b;
+                         }));
+
+  // Typing at a cursor shifts the shorter side of the segment.
+  auto cursor = contents.size() / 3;
+  for (uint64_t i = 0; i != 1000; ++i) {
+    c1.insert(c1.nth(cursor), i);
+    contents.insert(contents.begin() + static_cast<std::ptrdiff_t>(cursor), i);
+    if (i % 3 == 0) {
+      c1.erase(c1.nth(cursor + 1));
+      contents.erase(contents.begin() + static_cast<std::ptrdiff_t>(cursor) +
+                     1);
+    }
+  }
+  BOOST_CHECK(c1.size() == contents.size());
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin(),
+                         [](counted_move const& a, uint64_t b) {
+                           return a.value == b;
+                         }));
+  c1.shrink_to_fit();
+  BOOST_CHECK(std::equal(c1.rbegin(), c1.rend(), contents.rbegin(),
+                         [](counted_move const& a, uint64_t b) {
+                           return a.value == b;
+                         }));
+}
+
+BOOST_AUTO_TEST_CASE(test_push_front_moves) {
+  // Blocks split at the front keep their room in front, so building a
+  // sequence with push_front moves each element a bounded number of times.
+  seq<counted_move> c1;
+  counted_move::moves = 0;
+  for (uint64_t i = 0; i != 30752; ++i) c1.push_front(i);
+  BOOST_CHECK(counted_move::moves <= 10 * 30752);
+
+  counted_move::moves = 0;
+  for (uint64_t i = 30752; i != 0; --i) {
+    BOOST_CHECK(c1.front().value == i - 1);
+    c1.pop_front();
+  }
+  BOOST_CHECK(counted_move::moves <= 10 * 30752);
+  BOOST_CHECK(c1.empty());
+}
+
+// Owns its value on the heap and counts moves, which bitwise relocation skips.
+struct relocatable {
+  static std::size_t moves;
+  std::unique_ptr<uint64_t> value;
+
+  relocatable(uint64_t v) : value{new uint64_t{v}} {}
+  relocatable(relocatable&& other) noexcept : value{std::move(other.value)} {
+    ++moves;
+  }
+  relocatable& operator=(relocatable&& other) noexcept {
+    value = std::move(other.value);
+    ++moves;
+    return *this;
+  }
+};
+
+BOOST_AUTO_TEST_CASE(test_root_capacity) {
+  using alloc = counting_allocator<uint64_t>;
+  using seq_1024 = boost::segmented_tree::seq<uint64_t, alloc, 1024>;
+  // The elements whose room a segment's parent takes in front of it.
+  std::size_t parent = BOOST_SEGMENTED_TREE_BACK_POINTERS ? 2 : 0;
+  {
+    // A few elements take a small block instead of a full segment.
+    seq_1024 c1;
+    std::vector<uint64_t> contents;
+    auto allocations = alloc::allocations();
+    for (uint64_t i = 0; i != 3; ++i) {
+      c1.push_back(i);
+      contents.push_back(i);
+    }
+    BOOST_CHECK(alloc::allocations() == allocations + 1);
+    BOOST_CHECK(alloc::bytes() == (8 + parent) * sizeof(uint64_t));
+    test_iterator(c1, contents);
+
+    for (uint64_t i = 3; i != 9; ++i) {
+      c1.push_front(i);
+      contents.insert(contents.begin(), i);
+    }
+    BOOST_CHECK(alloc::live() == 1);
+    BOOST_CHECK(alloc::bytes() == (16 + parent) * sizeof(uint64_t));
+    test_iterator(c1, contents);
+
+    // The root segment doubles until it is full.
+    std::size_t capacity = 16;
+    for (uint64_t i = 9; i != 128; ++i) {
+      c1.push_back(i);
+      contents.push_back(i);
+      if (c1.size() > capacity) capacity *= 2;
+      BOOST_CHECK(alloc::bytes() == (capacity + parent) * sizeof(uint64_t));
+    }
+    BOOST_CHECK(alloc::live() == 1);
+
+    for (uint64_t i = 128; i != 1000; ++i) {
+      c1.insert(c1.nth(i / 2), i);
+      contents.insert(contents.begin() + static_cast<std::ptrdiff_t>(i / 2), i);
+    }
+    c1.erase(c1.nth(20), c1.end());
+    contents.erase(contents.begin() + 20, contents.end());
+    c1.shrink_to_fit();
+    BOOST_CHECK(alloc::live() == 1);
+    BOOST_CHECK(alloc::bytes() == (32 + parent) * sizeof(uint64_t));
+    test_iterator(c1, contents);
+
+    c1.erase(c1.nth(3), c1.end());
+    contents.erase(contents.begin() + 3, contents.end());
+    c1.shrink_to_fit();
+    BOOST_CHECK(alloc::bytes() == (8 + parent) * sizeof(uint64_t));
+    test_iterator(c1, contents);
+
+    // Reserved blocks cover growing out of the small block.
+    seq_1024 c2;
+    c2.reserve(1000);
+    allocations = alloc::allocations();
+    for (uint64_t i = 0; i != 1000; ++i) c2.push_back(i);
+    BOOST_CHECK(alloc::allocations() == allocations);
+  }
+  BOOST_CHECK(alloc::live() == 0);
+  BOOST_CHECK(alloc::bytes() == 0);
+}
+
+// Too large for a segment of any of the tested sizes.
+struct large_element {
+  uint64_t key;
+  unsigned char padding[1024];
+  large_element(uint64_t k) : key{k}, padding{} {}
+};
+
+BOOST_AUTO_TEST_CASE(test_large_elements) {
+  auto data = make_insertion_data_single<uint64_t>(3000ULL, 430452927ULL);
+  auto count = data.indexes.size();
+  seq<large_element> c1;
+  std::vector<uint64_t> contents;
+  auto equal = [&] {
+    auto key = [](large_element const& a, uint64_t b) { return a.key == b; };
+    return c1.size() == contents.size() &&
+           std::equal(c1.begin(), c1.end(), contents.begin(), key) &&
+           std::equal(c1.rbegin(), c1.rend(), contents.rbegin(), key);
+  };
+
+  for (std::size_t i = 0; i != count; ++i) {
+    auto index = static_cast<std::ptrdiff_t>(data.indexes[i]);
+    c1.emplace(c1.nth(data.indexes[i]), data.ordered[i]);
+    contents.insert(contents.begin() + index, data.ordered[i]);
+  }
+  BOOST_CHECK(equal());
+
+  for (std::size_t i = 0; i != count / 2; ++i) {
+    auto index = data.indexes[count - 1 - i] % contents.size();
+    c1.erase(c1.nth(index));
+    contents.erase(contents.begin() + static_cast<std::ptrdiff_t>(index));
+  }
+  BOOST_CHECK(equal());
+  c1.shrink_to_fit();
+  BOOST_CHECK(equal());
+}
+
+BOOST_AUTO_TEST_CASE(test_aligned_allocator) {
+  using alloc = boost::segmented_tree::aligned_allocator<uint64_t>;
+  alloc a;
+  for (std::size_t n = 1; n < 200; n += 7) {
+    auto p = a.allocate(n);
+    BOOST_CHECK(reinterpret_cast<std::uintptr_t>(p) % 64 == 0);
+    a.deallocate(p, n);
+  }
+
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  auto count = data.indexes.size();
+  seq<uint64_t, alloc> c1;
+  std::vector<uint64_t> contents;
+  for (std::size_t i = 0; i != count; ++i) {
+    auto index = static_cast<std::ptrdiff_t>(data.indexes[i]);
+    c1.insert(c1.nth(data.indexes[i]), data.ordered[i]);
+    contents.insert(contents.begin() + index, data.ordered[i]);
+  }
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin()));
+  BOOST_CHECK(std::equal(c1.rbegin(), c1.rend(), contents.rbegin()));
+
+  for (std::size_t i = 0; i != count / 2; ++i) {
+    auto index = data.indexes[count - 1 - i] % contents.size();
+    c1.erase(c1.nth(index));
+    contents.erase(contents.begin() + static_cast<std::ptrdiff_t>(index));
+  }
+  c1.shrink_to_fit();
+  BOOST_CHECK(std::equal(c1.begin(), c1.end(), contents.begin()));
+}
+
+std::size_t relocatable::moves = 0;
+
+namespace boost {
+namespace segmented_tree {
+template <>
+struct is_trivially_relocatable<relocatable> : std::true_type {};
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_trivially_relocatable) {
+  auto data = make_insertion_data_single<uint64_t>(30752ULL, 430452927ULL);
+  auto count = data.indexes.size();
+  seq<relocatable> c1;
+  std::vector<uint64_t> contents;
+  auto equal = [&] {
+    return c1.size() == contents.size() &&
+           std::equal(c1.begin(), c1.end(), contents.begin(),
+                      [](relocatable const& a, uint64_t b) {
+                        return *a.value == b;
+                      });
+  };
+
+  // Only passing each new element on to its slot runs move constructors.
+  relocatable::moves = 0;
+  for (std::size_t i = 0; i != count; ++i) {
+    auto index = static_cast<std::ptrdiff_t>(data.indexes[i]);
+    c1.emplace(c1.nth(data.indexes[i]), data.ordered[i]);
+    contents.insert(contents.begin() + index, data.ordered[i]);
+  }
+  BOOST_CHECK(relocatable::moves == 2 * count);
+  BOOST_CHECK(equal());
+
+  relocatable::moves = 0;
+  for (std::size_t i = 0; i != count / 2; ++i) {
+    auto index = data.indexes[count - 1 - i] % contents.size();
+    c1.erase(c1.nth(index));
+    contents.erase(contents.begin() + static_cast<std::ptrdiff_t>(index));
+  }
+  c1.compact(0.5);
+  BOOST_CHECK(equal());
+  c1.shrink_to_fit();
+  BOOST_CHECK(relocatable::moves == 0);
+  BOOST_CHECK(equal());
+
+  for (uint64_t i = 0; i != 1000; ++i) {
+    c1.emplace_front(i);
+    contents.insert(contents.begin(), i);
+    c1.pop_back();
+    contents.pop_back();
+  }
+  BOOST_CHECK(equal());
+}
+
 struct retry_exception {};
 
 template <typename T>
@@ -802,8 +1600,8 @@ inline bool operator!=(const throwing_allocator<T>& a,
 
 template <typename Container, typename T>
 void insert_single_retry(Container& container, insertion_data<T> const& data) {
+  // Not reserved up front, so that insertions keep hitting allocation failures.
   auto count = data.indexes.size();
-  reserve(container, count);
   for (std::size_t i = 0; i != count; ++i) {
     while (true) {
       try {